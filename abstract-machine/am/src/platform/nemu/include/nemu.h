@@ -28,10 +28,13 @@
 #define KBD_ADDR        (DEVICE_BASE + 0x0000060)
 #define RTC_ADDR        (DEVICE_BASE + 0x0000048)
 #define VGACTL_ADDR     (DEVICE_BASE + 0x0000100)
+#define GPU_ADDR        (DEVICE_BASE + 0x0000110)
 #define AUDIO_ADDR      (DEVICE_BASE + 0x0000200)
 #define DISK_ADDR       (DEVICE_BASE + 0x0000300)
+#define NET_ADDR        (DEVICE_BASE + 0x0000400)
 #define FB_ADDR         (MMIO_BASE   + 0x1000000)
 #define AUDIO_SBUF_ADDR (MMIO_BASE   + 0x1200000)
+#define GPU_MEM_ADDR    (MMIO_BASE   + 0x1400000)
 
 extern char _pmem_start;
 #define PMEM_SIZE (128 * 1024 * 1024)
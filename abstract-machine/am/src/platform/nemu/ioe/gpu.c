@@ -3,14 +3,21 @@
 
 #define SYNC_ADDR (VGACTL_ADDR + 4)
 
+enum { GPU_CMD_NONE, GPU_CMD_MEMCPY, GPU_CMD_RENDER };
+enum { reg_cmd, reg_src, reg_dest, reg_size, reg_root, reg_memsz };
+
+#define GPU_REG(r) (GPU_ADDR + (r) * 4)
+
 void __am_gpu_init() {
 }
 
+// without the accelerator, NEMU still maps its registers, which read 0
 void __am_gpu_config(AM_GPU_CONFIG_T *cfg) {
+  uint32_t memsz = inl(GPU_REG(reg_memsz));
   *cfg = (AM_GPU_CONFIG_T) {
-    .present = true, .has_accel = false,
+    .present = true, .has_accel = (memsz != 0),
     .width = 0, .height = 0,
-    .vmemsz = 0
+    .vmemsz = memsz
   };
 }
 
@@ -20,6 +27,19 @@ void __am_gpu_fbdraw(AM_GPU_FBDRAW_T *ctl) {
   }
 }
 
+// the device reads the source with physical addresses
+void __am_gpu_memcpy(AM_GPU_MEMCPY_T *params) {
+  outl(GPU_REG(reg_src), (uintptr_t)params->src);
+  outl(GPU_REG(reg_dest), params->dest);
+  outl(GPU_REG(reg_size), params->size);
+  outl(GPU_REG(reg_cmd), GPU_CMD_MEMCPY);
+}
+
+void __am_gpu_render(AM_GPU_RENDER_T *params) {
+  outl(GPU_REG(reg_root), params->root);
+  outl(GPU_REG(reg_cmd), GPU_CMD_RENDER);
+}
+
 void __am_gpu_status(AM_GPU_STATUS_T *status) {
   status->ready = true;
 }
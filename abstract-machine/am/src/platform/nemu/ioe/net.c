@@ -0,0 +1,85 @@
+#include <am.h>
+#include <nemu.h>
+#include <klib.h>
+
+#define NET_PRESENT_ADDR   (NET_ADDR + 0x00)
+#define NET_MTU_ADDR       (NET_ADDR + 0x04)
+#define NET_TX_RING_ADDR   (NET_ADDR + 0x08)
+#define NET_TX_NUM_ADDR    (NET_ADDR + 0x0c)
+#define NET_TX_HEAD_ADDR   (NET_ADDR + 0x10)
+#define NET_TX_TAIL_ADDR   (NET_ADDR + 0x14)
+#define NET_RX_RING_ADDR   (NET_ADDR + 0x18)
+#define NET_RX_NUM_ADDR    (NET_ADDR + 0x1c)
+#define NET_RX_HEAD_ADDR   (NET_ADDR + 0x20)
+#define NET_RX_TAIL_ADDR   (NET_ADDR + 0x24)
+#define NET_INTR_STAT_ADDR (NET_ADDR + 0x28)
+#define NET_COALESCE_ADDR  (NET_ADDR + 0x2c)
+
+#define NR_DESC 16
+#define MTU 1514
+
+typedef struct {
+  uint32_t addr;
+  uint16_t len;
+  uint16_t flags;
+} NetDesc;
+
+static NetDesc tx_ring[NR_DESC], rx_ring[NR_DESC];
+static uint8_t rx_buf[NR_DESC][MTU];
+static uint32_t tx_head = 0, rx_head = 0, rx_next = 0;
+static bool present = false, probed = false;
+
+// The NIC is probed on the first use, so that programs without
+// networking never touch its registers.
+static void net_probe() {
+  if (probed) return;
+  probed = true;
+  present = inl(NET_PRESENT_ADDR);
+  if (!present) return;
+  outl(NET_TX_RING_ADDR, (uintptr_t)tx_ring);
+  outl(NET_TX_NUM_ADDR, NR_DESC);
+  outl(NET_RX_RING_ADDR, (uintptr_t)rx_ring);
+  outl(NET_RX_NUM_ADDR, NR_DESC);
+  for (int i = 0; i < NR_DESC; i ++) {
+    rx_ring[i] = (NetDesc) { .addr = (uintptr_t)rx_buf[i], .len = MTU, .flags = 0 };
+  }
+  rx_head = NR_DESC;
+  outl(NET_RX_HEAD_ADDR, rx_head);
+}
+
+void __am_net_config(AM_NET_CONFIG_T *cfg) {
+  net_probe();
+  cfg->present = present;
+}
+
+void __am_net_status(AM_NET_STATUS_T *stat) {
+  net_probe();
+  stat->rx_len = (present && rx_next != inl(NET_RX_TAIL_ADDR) ? rx_ring[rx_next % NR_DESC].len : 0);
+  stat->tx_len = 0; // packets are sent as soon as they are submitted
+}
+
+void __am_net_tx(AM_NET_TX_T *tx) {
+  net_probe();
+  if (!present) return;
+  while (tx_head - inl(NET_TX_TAIL_ADDR) == NR_DESC) ;
+  tx_ring[tx_head % NR_DESC] = (NetDesc) {
+    .addr = (uintptr_t)tx->buf.start, .len = tx->buf.end - tx->buf.start, .flags = 0 };
+  tx_head ++;
+  outl(NET_TX_HEAD_ADDR, tx_head);
+}
+
+void __am_net_rx(AM_NET_RX_T *rx) {
+  net_probe();
+  if (!present || rx_next == inl(NET_RX_TAIL_ADDR)) return;
+  NetDesc *d = &rx_ring[rx_next % NR_DESC];
+  int len = rx->buf.end - rx->buf.start;
+  if (len > d->len) len = d->len;
+  memcpy(rx->buf.start, (void *)(uintptr_t)d->addr, len);
+
+  // give the buffer back to the device
+  d->len = MTU;
+  d->flags = 0;
+  rx_next ++;
+  rx_head ++;
+  outl(NET_RX_HEAD_ADDR, rx_head);
+}
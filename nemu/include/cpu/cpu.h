@@ -4,5 +4,6 @@
 #include <common.h>
 
 void cpu_exec(uint64_t n);
+void cpu_kick_intr_check();
 
 #endif
@@ -9,13 +9,23 @@ void difftest_skip_ref();
 void difftest_skip_dut(int nr_ref, int nr_dut);
 void difftest_set_patch(void (*fn)(void *arg), void *arg);
 void difftest_step(vaddr_t pc, vaddr_t npc);
+void difftest_raise_intr(word_t NO);
+void difftest_sync();
 void difftest_detach();
 void difftest_attach();
+#ifdef CONFIG_DIFFTEST_BATCH
+extern bool difftest_replaying;
+void difftest_record_input(paddr_t addr, word_t data);
+bool difftest_replay_input(paddr_t addr, word_t *data);
+uint64_t difftest_take_rewound();
+#endif
 #else
 static inline void difftest_skip_ref() {}
 static inline void difftest_skip_dut(int nr_ref, int nr_dut) {}
 static inline void difftest_set_patch(void (*fn)(void *arg), void *arg) {}
 static inline void difftest_step(vaddr_t pc, vaddr_t npc) {}
+static inline void difftest_raise_intr(word_t NO) {}
+static inline void difftest_sync() {}
 static inline void difftest_detach() {}
 static inline void difftest_attach() {}
 #endif
@@ -0,0 +1,38 @@
+#ifndef __CPU_FTRACE_H__
+#define __CPU_FTRACE_H__
+
+#include <common.h>
+
+#ifdef CONFIG_FTRACE
+// The function trace is a binary file with FTRACE_MAGIC followed by
+// records of three 64-bit words:
+//   kind << 56 | the number of instructions executed before the jump
+//   pc of the jump
+//   target of the jump
+// The last record is FTRACE_END with the total number of instructions.
+// tools/ftrace-dump reads it.
+
+#define FTRACE_MAGIC 0x31525446554d454eull // "NEMUFTR1"
+
+enum { FTRACE_CALL, FTRACE_RET, FTRACE_TAIL, FTRACE_END };
+
+void init_ftrace(const char *file);
+void ftrace_push(int kind, vaddr_t from, vaddr_t to);
+void ftrace_flush();
+
+// The shadow call stack follows the calls and returns pushed above, no
+// matter whether the trace is written. Frames deeper than FTRACE_STACK_MAX
+// are not kept.
+
+#define FTRACE_STACK_MAX 1024
+
+typedef struct {
+  vaddr_t func; // entry of the function called
+  vaddr_t ret;  // return address
+} FtraceFrame;
+
+extern FtraceFrame ftrace_stack[FTRACE_STACK_MAX];
+extern int ftrace_depth;
+#endif
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef __CPU_IRINGBUF_H__
+#define __CPU_IRINGBUF_H__
+
+#include <common.h>
+
+#ifdef CONFIG_IRINGBUF
+// The ring keeps the pc and the raw bits of the recent instructions. When
+// it is written to a file with --itrace, the file is IRINGBUF_MAGIC and the
+// LLVM triple of the guest (32 bytes), followed by the entries in the order
+// of execution. tools/itrace-dump disassembles it.
+
+#define IRINGBUF_MAGIC 0x3152494e554d454eull // "NEMUNIR1"
+#define IRINGBUF_MASK (CONFIG_IRINGBUF_SIZE - 1)
+
+typedef struct {
+  uint64_t pc;
+  uint32_t instr;
+  uint32_t ilen;
+} IRingEntry;
+
+extern IRingEntry iringbuf[CONFIG_IRINGBUF_SIZE];
+extern uint64_t iringbuf_nr; // number of entries pushed
+
+void init_iringbuf(const char *file, const char *triple);
+void iringbuf_full();
+void iringbuf_flush();
+void iringbuf_dump();
+
+static inline void iringbuf_push(vaddr_t pc, uint32_t instr, int ilen) {
+  IRingEntry *e = &iringbuf[iringbuf_nr & IRINGBUF_MASK];
+  e->pc = pc;
+  e->instr = instr;
+  e->ilen = ilen;
+  if (unlikely((++ iringbuf_nr & IRINGBUF_MASK) == 0)) iringbuf_full();
+}
+#endif
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef __CPU_PROFILE_H__
+#define __CPU_PROFILE_H__
+
+#include <common.h>
+
+#ifdef CONFIG_PROFILE
+// instructions to execute before the next sample
+extern uint64_t profile_budget;
+
+void init_profile(const char *file);
+void profile_sample();
+#endif
+
+#endif
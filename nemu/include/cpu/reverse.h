@@ -0,0 +1,19 @@
+#ifndef __CPU_REVERSE_H__
+#define __CPU_REVERSE_H__
+
+#include <common.h>
+
+#ifdef CONFIG_REVERSE
+// true when the instructions executed before are run again,
+// in which case devices are not touched and inputs come from the log
+extern bool reverse_replaying;
+
+void reverse_before_instr();
+void reverse_record_intr(word_t NO);
+void reverse_record_input(paddr_t addr, word_t data);
+bool reverse_replay_input(paddr_t addr, word_t *data);
+void reverse_step(uint64_t n);
+void reverse_continue();
+#endif
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef __CPU_STAT_H__
+#define __CPU_STAT_H__
+
+#include <common.h>
+
+#ifdef CONFIG_INSTR_STAT
+typedef struct {
+  uint64_t load[4], store[4]; // indexed by log2 of the width
+  uint64_t branch[2];         // not taken, taken
+  uint64_t mmio;              // loads and stores to devices
+} InstrStat;
+
+extern InstrStat g_stat;
+extern uint64_t g_stat_exec[]; // indexed by EXEC_ID
+
+#define stat_width_idx(len) __builtin_ctz(len)
+
+void stat_set_file(const char *file);
+void stat_dump(FILE *fp);
+void stat_write();
+#endif
+
+#endif
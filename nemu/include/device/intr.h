@@ -0,0 +1,20 @@
+#ifndef __DEVICE_INTR_H__
+#define __DEVICE_INTR_H__
+
+#include <common.h>
+
+// interrupt sources connected to the PLIC, 0 is reserved
+enum {
+  IRQ_NONE,
+  IRQ_SDCARD,
+  IRQ_DISK,
+  IRQ_VIRTIO_BLK,
+  IRQ_VIRTIO_CONSOLE,
+  IRQ_NET,
+  NR_IRQ
+};
+
+void dev_raise_intr(int irq);
+uint64_t dev_intr_update();
+
+#endif
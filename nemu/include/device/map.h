@@ -6,13 +6,23 @@
 typedef void(*io_callback_t)(uint32_t, int, bool);
 uint8_t* new_space(int size);
 
+enum {
+  MAP_IO,   // registers, the callback is invoked on every access
+  MAP_MEM,  // plain memory without callback
+  MAP_WC,   // write-combining memory, writes are notified on flush
+};
+
 typedef struct {
   const char *name;
+  int type;
   // we treat ioaddr_t as paddr_t here
   paddr_t low;
   paddr_t high;
   void *space;
   io_callback_t callback;
+  // dirty range of a write-combining map, as offsets
+  paddr_t dirty_low;
+  paddr_t dirty_high;
 } IOMap;
 
 static inline bool map_inside(IOMap *map, paddr_t addr) {
@@ -22,10 +32,7 @@ static inline bool map_inside(IOMap *map, paddr_t addr) {
 static inline int find_mapid_by_addr(IOMap *maps, int size, paddr_t addr) {
   int i;
   for (i = 0; i < size; i ++) {
-    if (map_inside(maps + i, addr)) {
-      difftest_skip_ref();
-      return i;
-    }
+    if (map_inside(maps + i, addr)) return i;
   }
   return -1;
 }
@@ -34,8 +41,12 @@ void add_pio_map(const char *name, ioaddr_t addr,
         void *space, uint32_t len, io_callback_t callback);
 void add_mmio_map(const char *name, paddr_t addr,
         void *space, uint32_t len, io_callback_t callback);
+void add_mmio_mem(const char *name, paddr_t addr, void *space, uint32_t len);
+void add_mmio_wc_map(const char *name, paddr_t addr,
+        void *space, uint32_t len, io_callback_t flush);
 
 word_t map_read(paddr_t addr, int len, IOMap *map);
 void map_write(paddr_t addr, int len, word_t data, IOMap *map);
+void map_flush(IOMap *map);
 
 #endif
@@ -5,5 +5,6 @@
 
 word_t mmio_read(paddr_t addr, int len);
 void mmio_write(paddr_t addr, int len, word_t data);
+void mmio_flush();
 
 #endif
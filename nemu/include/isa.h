@@ -17,6 +17,7 @@ void init_isa();
 extern CPU_state cpu;
 void isa_reg_display();
 word_t isa_reg_str2val(const char *name, bool *success);
+word_t *isa_reg_str2ptr(const char *name); // NULL if there is no such register
 
 // exec
 struct Decode;
@@ -35,6 +36,8 @@ paddr_t isa_mmu_translate(vaddr_t vaddr, int len, int type);
 vaddr_t isa_raise_intr(word_t NO, vaddr_t epc);
 #define INTR_EMPTY ((word_t)-1)
 word_t isa_query_intr();
+enum { INTR_LINE_SOFT, INTR_LINE_TIMER, INTR_LINE_EXTERNAL };
+void isa_set_intr_line(int line, bool level);
 
 // difftest
   // for dut
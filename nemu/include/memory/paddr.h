@@ -17,4 +17,9 @@ static inline bool in_pmem(paddr_t addr) {
 word_t paddr_read(paddr_t addr, int len);
 void paddr_write(paddr_t addr, int len, word_t data);
 
+/* track the pages of pmem written by the guest */
+typedef void (*pmem_write_hook_t)(paddr_t page);
+void pmem_track_writes(pmem_write_hook_t hook);
+void pmem_track_reset();
+
 #endif
@@ -19,6 +19,12 @@ extern NEMUState nemu_state;
 
 uint64_t get_time();
 
+// ----------- symbol table -----------
+
+void init_symtab(const char *elf_file);
+bool symtab_lookup(const char *name, vaddr_t *addr);
+const char* symtab_func(vaddr_t addr, vaddr_t *start);
+
 // ----------- log -----------
 
 #define ASNI_FG_BLACK   "\33[1;30m"
@@ -1,6 +1,11 @@
 #include <cpu/cpu.h>
 #include <cpu/exec.h>
 #include <cpu/difftest.h>
+#include <cpu/reverse.h>
+#include <cpu/ftrace.h>
+#include <cpu/profile.h>
+#include <cpu/stat.h>
+#include <cpu/iringbuf.h>
 #include <isa-all-instr.h>
 #include <locale.h>
 
@@ -14,15 +19,21 @@
 #ifdef CONFIG_WATCHPOINT
   bool wp_update_display_changed();
 #endif
+#ifndef CONFIG_TARGET_AM
+bool bp_check(vaddr_t pc);
+#endif
 
 CPU_state cpu = {};
 uint64_t g_nr_guest_instr = 0;
 static uint64_t g_timer = 0; // unit: us
+static uint64_t g_intr_budget = 1;
 static bool g_print_step = false;
 const rtlreg_t rzero = 0;
 rtlreg_t tmp_reg[4];
 
 void device_update();
+void serial_update();
+uint64_t dev_intr_update();
 void fetch_decode(Decode *s, vaddr_t pc);
 
 static void trace_and_difftest(Decode *_this, vaddr_t dnpc) {
@@ -35,6 +46,8 @@ static void trace_and_difftest(Decode *_this, vaddr_t dnpc) {
 #ifdef CONFIG_WATCHPOINT
   if (wp_update_display_changed()) nemu_state.state = NEMU_STOP;
 #endif
+  // cheap when there is no breakpoint, so always checked
+  IFNDEF(CONFIG_TARGET_AM, if (bp_check(dnpc)) nemu_state.state = NEMU_STOP);
 }
 
 #include <isa-exec.h>
@@ -50,6 +63,23 @@ static void fetch_decode_exec_updatepc(Decode *s) {
   cpu.pc = s->dnpc;
 }
 
+// check the pending interrupts after the current instruction
+void cpu_kick_intr_check() {
+  g_intr_budget = 1;
+}
+
+#ifdef CONFIG_DEVICE
+static void intr_check() {
+  g_intr_budget = dev_intr_update();
+  word_t NO = isa_query_intr();
+  if (NO != INTR_EMPTY) {
+    cpu.pc = isa_raise_intr(NO, cpu.pc);
+    difftest_raise_intr(NO);
+    IFDEF(CONFIG_REVERSE, reverse_record_intr(NO));
+  }
+}
+#endif
+
 static void statistic() {
   IFNDEF(CONFIG_TARGET_AM, setlocale(LC_NUMERIC, ""));
 #define NUMBERIC_FMT MUXDEF(CONFIG_TARGET_AM, "%ld", "%'ld")
@@ -57,11 +87,17 @@ static void statistic() {
   Log("total guest instructions = " NUMBERIC_FMT, g_nr_guest_instr);
   if (g_timer > 0) Log("simulation frequency = " NUMBERIC_FMT " instr/s", g_nr_guest_instr * 1000000 / g_timer);
   else Log("Finish running in less than 1 us and can not calculate the simulation frequency");
+  IFDEF(CONFIG_INSTR_STAT, stat_write());
 }
 
 void assert_fail_msg() {
+  // the guest's last partial line is most useful when NEMU crashes
+  IFDEF(CONFIG_HAS_SERIAL, serial_update());
   isa_reg_display();
   statistic();
+  IFDEF(CONFIG_FTRACE, ftrace_flush());
+  IFDEF(CONFIG_IRINGBUF, iringbuf_dump());
+  IFDEF(CONFIG_IRINGBUF, iringbuf_flush());
 }
 
 void fetch_decode(Decode *s, vaddr_t pc) {
@@ -70,6 +106,8 @@ void fetch_decode(Decode *s, vaddr_t pc) {
   int idx = isa_fetch_decode(s);
   s->dnpc = s->snpc;
   s->EHelper = g_exec_table[idx];
+  IFDEF(CONFIG_INSTR_STAT, g_stat_exec[idx] ++);
+  IFDEF(CONFIG_IRINGBUF, iringbuf_push(s->pc, s->isa.instr.val, s->snpc - s->pc));
 #ifdef CONFIG_ITRACE
   char *p = s->logbuf;
   p += snprintf(p, sizeof(s->logbuf), FMT_WORD ":", s->pc);
@@ -89,9 +127,31 @@ void fetch_decode(Decode *s, vaddr_t pc) {
   void disassemble(char *str, int size, uint64_t pc, uint8_t *code, int nbyte);
   disassemble(p, s->logbuf + sizeof(s->logbuf) - p,
       MUXDEF(CONFIG_ISA_x86, s->snpc, s->pc), (uint8_t *)&s->isa.instr.val, ilen);
+
+  vaddr_t fn_start;
+  const char *fn = symtab_func(s->pc, &fn_start);
+  if (fn != NULL) {
+    p += strlen(p);
+    snprintf(p, s->logbuf + sizeof(s->logbuf) - p, "  <%s+0x%lx>", fn, (uint64_t)(s->pc - fn_start));
+  }
 #endif
 }
 
+#ifdef CONFIG_REVERSE
+// Run the instructions again up to `target' for reverse execution, without
+// tracing and stopping. `check' is called after every instruction.
+void cpu_exec_seek(uint64_t target, void (*check)(vaddr_t dnpc)) {
+  Decode s;
+  // stop early if the replay diverges
+  while (g_nr_guest_instr < target && reverse_replaying) {
+    reverse_before_instr();
+    fetch_decode_exec_updatepc(&s);
+    g_nr_guest_instr ++;
+    if (check) check(cpu.pc);
+  }
+}
+#endif
+
 /* Simulate how the CPU works. */
 void cpu_exec(uint64_t n) {
   g_print_step = (n < MAX_INSTR_TO_PRINT);
@@ -106,13 +166,27 @@ void cpu_exec(uint64_t n) {
 
   Decode s;
   for (;n > 0; n --) {
+    IFDEF(CONFIG_REVERSE, reverse_before_instr());
     fetch_decode_exec_updatepc(&s);
     g_nr_guest_instr ++;
     trace_and_difftest(&s, cpu.pc);
+#ifdef CONFIG_DIFFTEST_BATCH
+    // the instructions rewound by the batched difftest are executed again
+    uint64_t nr_rewound = difftest_take_rewound();
+    n = (n + nr_rewound < n ? -1 : n + nr_rewound);
+#endif
     if (nemu_state.state != NEMU_RUNNING) break;
+    // devices are not touched and the profiler does not sample when
+    // replaying for reverse execution
+    if (MUXDEF(CONFIG_REVERSE, reverse_replaying, false)) continue;
+    IFDEF(CONFIG_PROFILE, if (-- profile_budget == 0) profile_sample());
+    IFDEF(CONFIG_DEVICE, if (-- g_intr_budget == 0) intr_check());
     IFDEF(CONFIG_DEVICE, device_update());
   }
 
+  // wait for the pipelined difftest to check the rest of the commit log
+  difftest_sync();
+
   uint64_t timer_end = get_time();
   g_timer += timer_end - timer_start;
 
@@ -125,6 +199,7 @@ void cpu_exec(uint64_t n) {
            (nemu_state.halt_ret == 0 ? ASNI_FMT("HIT GOOD TRAP", ASNI_FG_GREEN) :
             ASNI_FMT("HIT BAD TRAP", ASNI_FG_RED))),
           nemu_state.halt_pc);
+      IFDEF(CONFIG_IRINGBUF, if (nemu_state.state == NEMU_ABORT) iringbuf_dump());
       // fall through
     case NEMU_QUIT: statistic();
   }
@@ -2,7 +2,9 @@
 
 #include <isa.h>
 #include <cpu/cpu.h>
+#include <cpu/difftest.h>
 #include <memory/paddr.h>
+#include <memory/vaddr.h>
 #include <utils.h>
 #include <difftest-def.h>
 
@@ -14,11 +16,203 @@ void (*ref_difftest_raise_intr)(uint64_t NO) = NULL;
 #ifdef CONFIG_DIFFTEST
 
 static bool is_skip_ref = false;
+static bool is_detached = false;
 static int skip_dut_nr_instr = 0;
 
+void golden_record_open(const char *file, CPU_state *init);
+void golden_record(CPU_state *state, bool skip);
+void golden_flush();
+void golden_replay_open(const char *file, CPU_state *init);
+bool golden_replay_step(vaddr_t pc);
+
+enum { GOLDEN_NONE, GOLDEN_RECORD, GOLDEN_REPLAY };
+static int golden_mode = GOLDEN_NONE;
+static const char *golden_file = NULL;
+
+void difftest_set_golden(const char *file, bool record) {
+  golden_file = file;
+  golden_mode = (record ? GOLDEN_RECORD : GOLDEN_REPLAY);
+}
+#ifdef CONFIG_DIFFTEST_BATCH
+static CPU_state skip_cpu = {}; // DUT state before the skipped instruction
+#endif
+
+#ifdef CONFIG_DIFFTEST_PIPELINE
+#include <pthread.h>
+#include <sched.h>
+
+// In the pipelined mode, NEMU pushes its commit log into a single-producer
+// single-consumer ring of words, and a worker thread runs the REF and checks
+// the log. Each record is
+//   info (kind | nr_delta << 8), a, b, nr_delta * (reg index, value)
+// where the deltas are the words of the difftest registers changed since
+// the previous record.
+
+#define NR_DIFF_REG (DIFFTEST_REG_SIZE / sizeof(word_t))
+#define RING_SIZE CONFIG_DIFFTEST_PIPELINE_RING
+#define RING_MASK (RING_SIZE - 1)
+#define RECORD_MAX (3 + 2 * NR_DIFF_REG)
+
+static_assert((RING_SIZE & RING_MASK) == 0, "the size of the ring should be a power of 2");
+static_assert(DIFFTEST_REG_SIZE % sizeof(word_t) == 0, "difftest registers should be words");
+
+enum {
+  REC_STEP,     // a = pc, b = npc
+  REC_SKIP_REF, // a = pc, b = npc, copy the DUT state to REF
+  REC_SKIP_DUT, // a = nr_ref, b = nr_dut
+  REC_INTR,     // a = NO
+  REC_ATTACH,   // copy the DUT state to REF after attaching
+};
+
+static word_t ring[RING_SIZE];
+static uint64_t ring_head = 0; // consumed by the worker
+static uint64_t ring_tail = 0; // produced by NEMU
+
+// the DUT state as of the last pushed record
+static CPU_state dut_last = {};
+
+static struct {
+  bool diverged;
+  uint64_t nr_instr;  // number of the divergent instruction
+  vaddr_t pc;
+  int reg;            // index of the divergent register, or -1
+  word_t ref, dut;
+} divergence = {};
+
+static void pipeline_push(int kind, word_t a, word_t b) {
+  word_t *now = (word_t *)&cpu, *last = (word_t *)&dut_last;
+  word_t rec[RECORD_MAX];
+  int nr_delta = 0, i;
+  for (i = 0; i < NR_DIFF_REG; i ++) {
+    if (now[i] != last[i]) {
+      rec[3 + 2 * nr_delta] = i;
+      rec[4 + 2 * nr_delta] = now[i];
+      last[i] = now[i];
+      nr_delta ++;
+    }
+  }
+  rec[0] = kind | (nr_delta << 8);
+  rec[1] = a;
+  rec[2] = b;
+  int len = 3 + 2 * nr_delta;
+
+  uint64_t tail = ring_tail;
+  while (tail + len - __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE) > RING_SIZE) {
+    // the worker stops consuming after a divergence
+    if (__atomic_load_n(&divergence.diverged, __ATOMIC_ACQUIRE)) return;
+    sched_yield();
+  }
+  for (i = 0; i < len; i ++) {
+    ring[(tail + i) & RING_MASK] = rec[i];
+  }
+  __atomic_store_n(&ring_tail, tail + len, __ATOMIC_RELEASE);
+}
+
+static void report_divergence() {
+  static bool reported = false;
+  if (reported) return;
+  reported = true;
+  nemu_state.state = NEMU_ABORT;
+  nemu_state.halt_pc = divergence.pc;
+  if (divergence.reg == -1) {
+    Log("can not catch up with ref at pc = " FMT_WORD ", instruction #%ld",
+        divergence.pc, divergence.nr_instr);
+  } else {
+    Log("difftest register #%d is different after executing instruction #%ld at pc = " FMT_WORD
+        ", right = " FMT_WORD ", wrong = " FMT_WORD, divergence.reg, divergence.nr_instr,
+        divergence.pc, divergence.ref, divergence.dut);
+  }
+}
+
+static void *pipeline_worker(void *arg) {
+  CPU_state dut = cpu, ref_r;
+  word_t *dut_w = (word_t *)&dut, *ref_w = (word_t *)&ref_r;
+  uint64_t head = 0, nr_instr = 0;
+  int skip_dut = 0;
+
+  while (true) {
+    while (__atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE) == head) sched_yield();
+
+    word_t info = ring[head & RING_MASK];
+    word_t a = ring[(head + 1) & RING_MASK];
+    word_t b = ring[(head + 2) & RING_MASK];
+    int kind = info & 0xff, nr_delta = info >> 8, i;
+    for (i = 0; i < nr_delta; i ++) {
+      dut_w[ring[(head + 3 + 2 * i) & RING_MASK]] = ring[(head + 4 + 2 * i) & RING_MASK];
+    }
+    __atomic_store_n(&ring_head, head + 3 + 2 * nr_delta, __ATOMIC_RELEASE);
+    head += 3 + 2 * nr_delta;
+
+    int reg = -2;
+    switch (kind) {
+      case REC_INTR: ref_difftest_raise_intr(a); continue;
+      case REC_SKIP_DUT:
+        skip_dut += b;
+        while (a -- > 0) ref_difftest_exec(1);
+        continue;
+      case REC_SKIP_REF:
+        nr_instr ++;
+        ref_difftest_regcpy(&dut, DIFFTEST_TO_REF);
+        // REF now holds the DUT state, so there is nothing to catch up with
+        skip_dut = 0;
+        continue;
+      case REC_ATTACH:
+        ref_difftest_regcpy(&dut, DIFFTEST_TO_REF);
+        continue;
+      case REC_STEP:
+        nr_instr ++;
+        if (skip_dut > 0) {
+          ref_difftest_regcpy(&ref_r, DIFFTEST_TO_DUT);
+          if (ref_r.pc != b) {
+            if (-- skip_dut == 0) reg = -1;
+            break;
+          }
+          skip_dut = 0;
+        } else {
+          ref_difftest_exec(1);
+          ref_difftest_regcpy(&ref_r, DIFFTEST_TO_DUT);
+        }
+        for (i = 0; i < NR_DIFF_REG; i ++) {
+          if (ref_w[i] != dut_w[i]) { reg = i; break; }
+        }
+        break;
+      default: panic("bad commit log record kind = %d", kind);
+    }
+
+    if (reg != -2) {
+      divergence.nr_instr = nr_instr;
+      divergence.pc = a;
+      divergence.reg = reg;
+      divergence.ref = (reg >= 0 ? ref_w[reg] : 0);
+      divergence.dut = (reg >= 0 ? dut_w[reg] : 0);
+      __atomic_store_n(&divergence.diverged, true, __ATOMIC_RELEASE);
+      return NULL;
+    }
+  }
+}
+
+static void init_pipeline() {
+  dut_last = cpu;
+  pthread_t thread;
+  int ret = pthread_create(&thread, NULL, pipeline_worker, NULL);
+  assert(ret == 0);
+  pthread_detach(thread);
+  Log("Differential testing is pipelined with a ring of %d words", RING_SIZE);
+}
+
+static void pipeline_sync() {
+  while (__atomic_load_n(&ring_head, __ATOMIC_ACQUIRE) != ring_tail) {
+    if (__atomic_load_n(&divergence.diverged, __ATOMIC_ACQUIRE)) break;
+    sched_yield();
+  }
+  if (__atomic_load_n(&divergence.diverged, __ATOMIC_ACQUIRE)) report_divergence();
+}
+#endif
+
 // this is used to let ref skip instructions which
 // can not produce consistent behavior with NEMU
 void difftest_skip_ref() {
+  IFDEF(CONFIG_DIFFTEST_BATCH, if (!is_skip_ref) skip_cpu = cpu);
   is_skip_ref = true;
   // If such an instruction is one of the instruction packing in QEMU
   // (see below), we end the process of catching up with QEMU's pc to
@@ -27,7 +221,7 @@ void difftest_skip_ref() {
   // already write some memory, and the incoming instruction in NEMU
   // will load that memory, we will encounter false negative. But such
   // situation is infrequent.
-  skip_dut_nr_instr = 0;
+  IFNDEF(CONFIG_DIFFTEST_PIPELINE, skip_dut_nr_instr = 0);
 }
 
 // this is used to deal with instruction packing in QEMU.
@@ -37,6 +231,12 @@ void difftest_skip_ref() {
 //   Let REF run `nr_ref` instructions first.
 //   We expect that DUT will catch up with REF within `nr_dut` instructions.
 void difftest_skip_dut(int nr_ref, int nr_dut) {
+  if (golden_mode == GOLDEN_REPLAY || is_detached) return;
+#ifdef CONFIG_DIFFTEST_PIPELINE
+  pipeline_push(REC_SKIP_DUT, nr_ref, nr_dut);
+  return;
+#endif
+  IFDEF(CONFIG_DIFFTEST_BATCH, panic("skipping DUT is not supported in the batched mode"));
   skip_dut_nr_instr += nr_dut;
 
   while (nr_ref -- > 0) {
@@ -44,7 +244,235 @@ void difftest_skip_dut(int nr_ref, int nr_dut) {
   }
 }
 
+static void checkregs(CPU_state *ref, vaddr_t pc) {
+  if (!isa_difftest_checkregs(ref, pc)) {
+    word_t *ref_w = (word_t *)ref, *dut_w = (word_t *)&cpu;
+    int i;
+    for (i = 0; i < DIFFTEST_REG_SIZE / sizeof(word_t); i ++) {
+      if (ref_w[i] != dut_w[i]) {
+        Log("difftest register #%d is different after executing instruction at pc = " FMT_WORD
+            ", right = " FMT_WORD ", wrong = " FMT_WORD, i, pc, ref_w[i], dut_w[i]);
+        break;
+      }
+    }
+    nemu_state.state = NEMU_ABORT;
+    nemu_state.halt_pc = pc;
+    isa_reg_display();
+  }
+}
+
+#ifdef CONFIG_DIFFTEST_BATCH
+// In the batched mode, REF and DUT run a batch of instructions between
+// checkpoints, where the registers and the pages written by DUT since the
+// last checkpoint are compared. The old content of these pages is saved on
+// their first write, so both sides can be rewound to the last checkpoint.
+// The batch is then executed again with comparison after every instruction
+// to find the first divergent one. Both use isa_difftest_checkregs().
+//
+// The values read from device registers within a batch are logged, and
+// returned again when the batch is executed again. Writes to device
+// registers are dropped then, since the devices have seen them. If DUT
+// reads a different register when executing again (e.g. it takes an
+// interrupt at another instruction), the log is abandoned and the devices
+// are accessed for the rest of the batch.
+
+extern uint64_t g_nr_guest_instr;
+
+typedef struct {
+  paddr_t addr;
+  uint8_t data[PAGE_SIZE];
+} SavedPage;
+
+static CPU_state ckpt_cpu = {};
+static uint64_t ckpt_nr_instr = 0;
+static SavedPage *saved = NULL;
+static int nr_saved = 0, max_saved = 0;
+static uint64_t nr_pending = 0; // instructions not executed by REF yet
+static uint64_t nr_precise = 0; // instructions left to compare one by one
+static uint64_t nr_rewound = 0; // instructions to execute again, see cpu_exec()
+
+typedef struct {
+  paddr_t addr;
+  word_t data;
+} Input;
+
+static Input *input = NULL;
+static int nr_input = 0, max_input = 0, replay_idx = 0;
+bool difftest_replaying = false;
+
+void difftest_record_input(paddr_t addr, word_t data) {
+  if (difftest_replaying || is_detached || golden_mode == GOLDEN_REPLAY) return;
+  if (nr_input == max_input) {
+    max_input = (max_input == 0 ? 64 : max_input * 2);
+    input = realloc(input, sizeof(Input) * max_input);
+    assert(input);
+  }
+  input[nr_input ++] = (Input){ .addr = addr, .data = data };
+}
+
+bool difftest_replay_input(paddr_t addr, word_t *data) {
+  if (!difftest_replaying) return false;
+  if (replay_idx == nr_input || input[replay_idx].addr != addr) {
+    Log("device input diverges when executing the batch again at addr = " FMT_PADDR
+        ", the devices are accessed from now on", addr);
+    difftest_replaying = false;
+    return false;
+  }
+  *data = input[replay_idx ++].data;
+  return true;
+}
+
+uint64_t difftest_take_rewound() {
+  uint64_t n = nr_rewound;
+  nr_rewound = 0;
+  return n;
+}
+
+static void save_page(paddr_t page) {
+  if (nr_saved == max_saved) {
+    max_saved = (max_saved == 0 ? 64 : max_saved * 2);
+    saved = realloc(saved, sizeof(SavedPage) * max_saved);
+    assert(saved);
+  }
+  saved[nr_saved].addr = page;
+  memcpy(saved[nr_saved].data, guest_to_host(page), PAGE_SIZE);
+  nr_saved ++;
+}
+
+static void checkpoint() {
+  ckpt_cpu = cpu;
+  ckpt_nr_instr = g_nr_guest_instr;
+  nr_saved = 0;
+  nr_pending = 0;
+  nr_input = 0;
+  difftest_replaying = false;
+  pmem_track_reset();
+}
+
+static bool check_pages() {
+  static uint8_t buf[PAGE_SIZE];
+  int i;
+  for (i = 0; i < nr_saved; i ++) {
+    ref_difftest_memcpy(saved[i].addr, buf, PAGE_SIZE, DIFFTEST_TO_DUT);
+    if (memcmp(buf, guest_to_host(saved[i].addr), PAGE_SIZE) != 0) return false;
+  }
+  return true;
+}
+
+// let REF catch up, and compare it with DUT
+static bool batch_check() {
+  CPU_state ref_r;
+  if (nr_pending > 0) ref_difftest_exec(nr_pending);
+  nr_pending = 0;
+  ref_difftest_regcpy(&ref_r, DIFFTEST_TO_DUT);
+  return isa_difftest_checkregs(&ref_r, cpu.pc) && check_pages();
+}
+
+static void batch_rewind() {
+  Log("difftest mismatch within instructions (%ld, %ld], "
+      "rewind to find the first divergent one", ckpt_nr_instr, g_nr_guest_instr);
+  int i;
+  for (i = 0; i < nr_saved; i ++) {
+    memcpy(guest_to_host(saved[i].addr), saved[i].data, PAGE_SIZE);
+    ref_difftest_memcpy(saved[i].addr, saved[i].data, PAGE_SIZE, DIFFTEST_TO_REF);
+  }
+  nr_precise = g_nr_guest_instr - ckpt_nr_instr;
+  nr_rewound += nr_precise;
+  cpu = ckpt_cpu;
+  ref_difftest_regcpy(&cpu, DIFFTEST_TO_REF);
+  g_nr_guest_instr = ckpt_nr_instr;
+  is_skip_ref = false;
+  int n = nr_input;
+  checkpoint();
+  // replay the device input logged in the batch
+  nr_input = n;
+  replay_idx = 0;
+  difftest_replaying = true;
+  // execute the batch again even if it ended the program
+  if (nemu_state.state == NEMU_END || nemu_state.state == NEMU_ABORT) {
+    nemu_state.state = NEMU_RUNNING;
+  }
+}
+
+static void precise_step(vaddr_t pc) {
+  if (is_skip_ref) {
+    ref_difftest_regcpy(&cpu, DIFFTEST_TO_REF);
+    is_skip_ref = false;
+  } else {
+    CPU_state ref_r;
+    ref_difftest_exec(1);
+    ref_difftest_regcpy(&ref_r, DIFFTEST_TO_DUT);
+    checkregs(&ref_r, pc);
+    if (nemu_state.state != NEMU_ABORT && !check_pages()) {
+      Log("memory is different after executing instruction at pc = " FMT_WORD, pc);
+      nemu_state.state = NEMU_ABORT;
+      nemu_state.halt_pc = pc;
+    }
+  }
+  if (-- nr_precise == 0) checkpoint();
+}
+
+static void batch_step(vaddr_t pc) {
+  if (nr_precise > 0) { precise_step(pc); return; }
+
+  if (is_skip_ref) {
+    // REF stops before the skipped instruction, then takes the state of DUT
+    is_skip_ref = false;
+    // compare with the DUT state before the skipped instruction
+    CPU_state now = cpu;
+    cpu = skip_cpu;
+    bool ok = batch_check();
+    cpu = now;
+    if (!ok) { batch_rewind(); return; }
+    ref_difftest_regcpy(&cpu, DIFFTEST_TO_REF);
+    checkpoint();
+    return;
+  }
+
+  nr_pending ++;
+  if (nr_pending >= CONFIG_DIFFTEST_BATCH_SIZE || nemu_state.state != NEMU_RUNNING) {
+    if (!batch_check()) { batch_rewind(); return; }
+    checkpoint();
+  }
+}
+
+static void batch_raise_intr(word_t NO) {
+  // DUT has taken the interrupt, so let REF catch up and take it too
+  if (nr_pending > 0) ref_difftest_exec(nr_pending);
+  nr_pending = 0;
+  ref_difftest_raise_intr(NO);
+  if (nr_precise > 0) return;
+  if (!batch_check()) { batch_rewind(); return; }
+  checkpoint();
+}
+
+static void batch_sync() {
+  if (nr_precise > 0 || nr_pending == 0) return;
+  if (!batch_check()) {
+    batch_rewind();
+    // the rest of the batch will be checked one by one when continuing
+    nr_rewound = 0;
+    if (nemu_state.state == NEMU_RUNNING) nemu_state.state = NEMU_STOP;
+    return;
+  }
+  checkpoint();
+}
+
+static void init_batch() {
+  pmem_track_writes(save_page);
+  checkpoint();
+  Log("Differential testing is batched every %d instructions", CONFIG_DIFFTEST_BATCH_SIZE);
+}
+#endif
+
 void init_difftest(char *ref_so_file, long img_size, int port) {
+  if (golden_mode == GOLDEN_REPLAY) {
+    // no REF is needed
+    Log("Differential testing: %s", ASNI_FMT("ON", ASNI_FG_GREEN));
+    golden_replay_open(golden_file, &cpu);
+    return;
+  }
+
   assert(ref_so_file != NULL);
 
   void *handle;
@@ -74,17 +502,105 @@ void init_difftest(char *ref_so_file, long img_size, int port) {
   ref_difftest_init(port);
   ref_difftest_memcpy(RESET_VECTOR, guest_to_host(RESET_VECTOR), img_size, DIFFTEST_TO_REF);
   ref_difftest_regcpy(&cpu, DIFFTEST_TO_REF);
+  IFDEF(CONFIG_DIFFTEST_PIPELINE, init_pipeline());
+  IFDEF(CONFIG_DIFFTEST_BATCH, init_batch());
+
+  if (golden_mode == GOLDEN_RECORD) {
+    Assert(MUXDEF(CONFIG_DIFFTEST_MODE_STEP, true, false),
+        "golden traces can only be recorded when comparing after every instruction");
+    golden_record_open(golden_file, &cpu);
+  }
 }
 
-static void checkregs(CPU_state *ref, vaddr_t pc) {
-  if (!isa_difftest_checkregs(ref, pc)) {
-    nemu_state.state = NEMU_ABORT;
-    nemu_state.halt_pc = pc;
-    isa_reg_display();
+// While detached, DUT runs alone and the pages it writes are recorded.
+// Only these pages are copied to REF when attaching again.
+static paddr_t *dirty_pages = NULL;
+static int nr_dirty = 0, max_dirty = 0;
+
+static void mark_dirty(paddr_t page) {
+  if (nr_dirty == max_dirty) {
+    max_dirty = (max_dirty == 0 ? 1024 : max_dirty * 2);
+    dirty_pages = realloc(dirty_pages, sizeof(paddr_t) * max_dirty);
+    assert(dirty_pages);
+  }
+  dirty_pages[nr_dirty ++] = page;
+}
+
+void difftest_detach() {
+  if (is_detached) return;
+  if (golden_mode != GOLDEN_NONE) {
+    Log("Can not detach when checking with golden traces");
+    return;
+  }
+  // check the instructions executed so far
+  difftest_sync();
+  is_detached = true;
+  nr_dirty = 0;
+  pmem_track_writes(mark_dirty);
+  Log("Differential testing: %s", ASNI_FMT("OFF", ASNI_FG_RED));
+}
+
+void difftest_attach() {
+  if (!is_detached) return;
+  int i;
+  for (i = 0; i < nr_dirty; i ++) {
+    ref_difftest_memcpy(dirty_pages[i], guest_to_host(dirty_pages[i]), PAGE_SIZE, DIFFTEST_TO_REF);
   }
+  isa_difftest_attach();
+  is_detached = false;
+  pmem_track_writes(MUXDEF(CONFIG_DIFFTEST_BATCH, save_page, NULL));
+#if defined(CONFIG_DIFFTEST_PIPELINE)
+  pipeline_push(REC_ATTACH, cpu.pc, 0);
+#else
+  ref_difftest_regcpy(&cpu, DIFFTEST_TO_REF);
+  IFDEF(CONFIG_DIFFTEST_BATCH, checkpoint());
+#endif
+  Log("Differential testing: %s, %d dirty pages are synchronized",
+      ASNI_FMT("ON", ASNI_FG_GREEN), nr_dirty);
+}
+
+void difftest_raise_intr(word_t NO) {
+  if (golden_mode == GOLDEN_REPLAY || is_detached) return;
+#if defined(CONFIG_DIFFTEST_PIPELINE)
+  pipeline_push(REC_INTR, NO, 0);
+#elif defined(CONFIG_DIFFTEST_BATCH)
+  batch_raise_intr(NO);
+#else
+  ref_difftest_raise_intr(NO);
+#endif
+}
+
+void difftest_sync() {
+  if (golden_mode == GOLDEN_RECORD) golden_flush();
+  if (is_detached) return;
+  IFDEF(CONFIG_DIFFTEST_PIPELINE, pipeline_sync());
+  IFDEF(CONFIG_DIFFTEST_BATCH, batch_sync());
 }
 
 void difftest_step(vaddr_t pc, vaddr_t npc) {
+  if (is_detached) {
+    is_skip_ref = false;
+    return;
+  }
+  if (golden_mode == GOLDEN_REPLAY) {
+    is_skip_ref = false;
+    if (!golden_replay_step(pc)) {
+      nemu_state.state = NEMU_ABORT;
+      nemu_state.halt_pc = pc;
+      isa_reg_display();
+    }
+    return;
+  }
+#ifdef CONFIG_DIFFTEST_PIPELINE
+  pipeline_push(is_skip_ref ? REC_SKIP_REF : REC_STEP, pc, npc);
+  is_skip_ref = false;
+  if (__atomic_load_n(&divergence.diverged, __ATOMIC_ACQUIRE)) report_divergence();
+  return;
+#endif
+#ifdef CONFIG_DIFFTEST_BATCH
+  batch_step(pc);
+  return;
+#endif
   CPU_state ref_r;
 
   if (skip_dut_nr_instr > 0) {
@@ -92,8 +608,10 @@ void difftest_step(vaddr_t pc, vaddr_t npc) {
     if (ref_r.pc == npc) {
       skip_dut_nr_instr = 0;
       checkregs(&ref_r, npc);
+      if (golden_mode == GOLDEN_RECORD) golden_record(&ref_r, false);
       return;
     }
+    if (golden_mode == GOLDEN_RECORD) golden_record(&cpu, true);
     skip_dut_nr_instr --;
     if (skip_dut_nr_instr == 0)
       panic("can not catch up with ref.pc = " FMT_WORD " at pc = " FMT_WORD, ref_r.pc, pc);
@@ -104,14 +622,17 @@ void difftest_step(vaddr_t pc, vaddr_t npc) {
     // to skip the checking of an instruction, just copy the reg state to reference design
     ref_difftest_regcpy(&cpu, DIFFTEST_TO_REF);
     is_skip_ref = false;
+    if (golden_mode == GOLDEN_RECORD) golden_record(&cpu, true);
     return;
   }
 
   ref_difftest_exec(1);
   ref_difftest_regcpy(&ref_r, DIFFTEST_TO_DUT);
+  if (golden_mode == GOLDEN_RECORD) golden_record(&ref_r, false);
 
   checkregs(&ref_r, pc);
 }
 #else
 void init_difftest(char *ref_so_file, long img_size, int port) { }
+void difftest_set_golden(const char *file, bool record) { }
 #endif
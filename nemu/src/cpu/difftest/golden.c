@@ -0,0 +1,163 @@
+#include <isa.h>
+#include <difftest-def.h>
+
+#ifdef CONFIG_DIFFTEST
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stddef.h>
+
+// A golden trace records the state of REF after every instruction, so that
+// DUT can be checked against it later without running REF again.
+//
+// The file starts with a header, followed by one record per instruction:
+//   byte    [skip:1][nr_changed:7]
+//   varint  pc - previous pc
+//   nr_changed * (byte reg index, varint value - previous value)
+// where varints are zigzag encoded LEB128, and the registers are the words
+// covered by DIFFTEST_REG_SIZE except pc. Records marked with `skip` come
+// from instructions skipped by difftest, and they are not compared.
+//
+// The trace is only valid for DUT runs with deterministic devices, since
+// the values returned by devices are not part of the trace.
+
+#define NR_DIFF_REG (DIFFTEST_REG_SIZE / sizeof(word_t))
+#define PC_IDX (offsetof(CPU_state, pc) / sizeof(word_t))
+#define GOLDEN_MAGIC 0x31544f474d454e4eull // "NEMUGOT1"
+
+static_assert(PC_IDX < NR_DIFF_REG, "pc should be a difftest register");
+
+typedef struct {
+  uint64_t magic;
+  uint32_t nr_reg;
+  uint32_t word_size;
+  word_t init[NR_DIFF_REG];
+} GoldenHeader;
+
+static word_t last[NR_DIFF_REG] = {};
+static uint64_t nr_record = 0;
+
+/* recorder */
+
+static FILE *record_fp = NULL;
+
+static uint8_t *put_varint(uint8_t *p, word_t delta) {
+  uint64_t v = ((uint64_t)(int64_t)(sword_t)delta << 1) ^ (uint64_t)((int64_t)(sword_t)delta >> 63);
+  while (v >= 0x80) {
+    *p ++ = (v & 0x7f) | 0x80;
+    v >>= 7;
+  }
+  *p ++ = v;
+  return p;
+}
+
+void golden_record_open(const char *file, CPU_state *init) {
+  record_fp = fopen(file, "w");
+  Assert(record_fp, "Can not open '%s'", file);
+  static char buf[1 << 20];
+  setvbuf(record_fp, buf, _IOFBF, sizeof(buf));
+
+  GoldenHeader h = { .magic = GOLDEN_MAGIC, .nr_reg = NR_DIFF_REG, .word_size = sizeof(word_t) };
+  memcpy(h.init, init, sizeof(h.init));
+  memcpy(last, init, sizeof(last));
+  int ret = fwrite(&h, sizeof(h), 1, record_fp);
+  assert(ret == 1);
+  Log("Record the golden trace to %s", file);
+}
+
+void golden_record(CPU_state *state, bool skip) {
+  word_t *now = (word_t *)state;
+  uint8_t rec[2 + 11 + NR_DIFF_REG * 12];
+  uint8_t *p = rec + 1;
+  int nr_changed = 0, i;
+  p = put_varint(p, now[PC_IDX] - last[PC_IDX]);
+  last[PC_IDX] = now[PC_IDX];
+  for (i = 0; i < NR_DIFF_REG; i ++) {
+    if (i == PC_IDX || now[i] == last[i]) continue;
+    *p ++ = i;
+    p = put_varint(p, now[i] - last[i]);
+    last[i] = now[i];
+    nr_changed ++;
+  }
+  rec[0] = (skip ? 0x80 : 0) | nr_changed;
+  int ret = fwrite(rec, p - rec, 1, record_fp);
+  assert(ret == 1);
+  nr_record ++;
+}
+
+void golden_flush() {
+  if (record_fp != NULL) fflush(record_fp);
+}
+
+/* replayer */
+
+static uint8_t *trace = NULL, *trace_p = NULL, *trace_end = NULL;
+
+static word_t get_varint() {
+  uint64_t v = 0;
+  int shift = 0;
+  uint8_t b;
+  do {
+    Assert(trace_p < trace_end, "the golden trace is truncated");
+    Assert(shift < 64, "the golden trace is corrupt: varint too long");
+    b = *trace_p ++;
+    v |= (uint64_t)(b & 0x7f) << shift;
+    shift += 7;
+  } while (b & 0x80);
+  return (v >> 1) ^ -(v & 1);
+}
+
+void golden_replay_open(const char *file, CPU_state *init) {
+  int fd = open(file, O_RDONLY);
+  Assert(fd != -1, "Can not open '%s'", file);
+  struct stat st;
+  int ret = fstat(fd, &st);
+  assert(ret == 0);
+  Assert(st.st_size >= sizeof(GoldenHeader), "'%s' is not a golden trace", file);
+  trace = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  assert(trace != MAP_FAILED);
+  close(fd);
+  madvise(trace, st.st_size, MADV_SEQUENTIAL);
+
+  GoldenHeader *h = (void *)trace;
+  Assert(h->magic == GOLDEN_MAGIC && h->nr_reg == NR_DIFF_REG && h->word_size == sizeof(word_t),
+      "'%s' is not a golden trace for this ISA", file);
+  Assert(memcmp(h->init, init, sizeof(h->init)) == 0,
+      "the initial state in '%s' is different from DUT", file);
+  memcpy(last, h->init, sizeof(last));
+  trace_p = trace + sizeof(GoldenHeader);
+  trace_end = trace + st.st_size;
+  Log("Check against the golden trace %s", file);
+}
+
+// return false if DUT is different from the trace
+bool golden_replay_step(vaddr_t pc) {
+  if (trace_p == trace_end) {
+    Log("the golden trace ends after %ld instructions", nr_record);
+    return false;
+  }
+  uint8_t info = *trace_p ++;
+  last[PC_IDX] += get_varint();
+  int nr_changed = info & 0x7f, i;
+  for (i = 0; i < nr_changed; i ++) {
+    Assert(trace_p < trace_end, "the golden trace is truncated");
+    int idx = *trace_p ++;
+    Assert(idx < NR_DIFF_REG, "the golden trace is corrupt: bad register #%d", idx);
+    last[idx] += get_varint();
+  }
+  nr_record ++;
+  if (info & 0x80) return true;
+
+  word_t *dut = (word_t *)&cpu;
+  for (i = 0; i < NR_DIFF_REG; i ++) {
+    if (dut[i] != last[i]) {
+      Log("difftest register #%d is different from the golden trace after executing "
+          "instruction #%ld at pc = " FMT_WORD ", right = " FMT_WORD ", wrong = " FMT_WORD,
+          i, nr_record, pc, last[i], dut[i]);
+      return false;
+    }
+  }
+  return true;
+}
+#endif
@@ -0,0 +1,122 @@
+#include <isa.h>
+#include <cpu/ftrace.h>
+#include <cpu/reverse.h>
+
+#ifdef CONFIG_FTRACE
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+// The records are pushed into a single-producer single-consumer ring,
+// and a writer thread drains the ring to the file, so that the guest
+// only pays for a few stores on a call or a return. NEMU waits for the
+// writer when the ring is full, and no record is lost.
+
+#define RING_SIZE CONFIG_FTRACE_RING
+#define RING_MASK (RING_SIZE - 1)
+
+static_assert((RING_SIZE & RING_MASK) == 0, "the size of the ring should be a power of 2");
+
+typedef struct {
+  uint64_t instr;
+  uint64_t from;
+  uint64_t to;
+} FtraceRecord;
+
+extern uint64_t g_nr_guest_instr;
+
+static FtraceRecord ring[RING_SIZE];
+static uint64_t ring_head = 0; // consumed by the writer
+static uint64_t ring_tail = 0; // produced by NEMU
+static FILE *fp = NULL;
+
+static void *ftrace_writer(void *arg) {
+  uint64_t head = 0;
+  while (true) {
+    uint64_t tail = __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE);
+    if (tail == head) { usleep(100); continue; }
+    // write up to the end of the ring at a time
+    uint64_t end = (head | RING_MASK) + 1;
+    if (end > tail) end = tail;
+    size_t ret = fwrite(&ring[head & RING_MASK], sizeof(ring[0]), end - head, fp);
+    assert(ret == end - head);
+    head = end;
+    __atomic_store_n(&ring_head, head, __ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+void init_ftrace(const char *file) {
+  if (file == NULL) return;
+  fp = fopen(file, "w");
+  Assert(fp, "Can not open '%s'", file);
+  static char buf[1 << 20];
+  setvbuf(fp, buf, _IOFBF, sizeof(buf));
+  uint64_t magic = FTRACE_MAGIC;
+  int ret = fwrite(&magic, sizeof(magic), 1, fp);
+  assert(ret == 1);
+
+  pthread_t thread;
+  ret = pthread_create(&thread, NULL, ftrace_writer, NULL);
+  assert(ret == 0);
+  pthread_detach(thread);
+  atexit(ftrace_flush);
+  Log("Function trace is written to %s", file);
+}
+
+/* shadow call stack */
+
+FtraceFrame ftrace_stack[FTRACE_STACK_MAX];
+int ftrace_depth = 0;
+static int nr_lost = 0; // frames deeper than FTRACE_STACK_MAX
+
+static void stack_call(vaddr_t to, vaddr_t ret) {
+  if (ftrace_depth == FTRACE_STACK_MAX) { nr_lost ++; return; }
+  ftrace_stack[ftrace_depth ++] = (FtraceFrame){ .func = to, .ret = ret };
+}
+
+static void stack_ret(vaddr_t to) {
+  if (nr_lost > 0) { nr_lost --; return; }
+  // a return not matching the calls (e.g. longjmp) unwinds to the frame
+  // it returns to, or just drops one frame if there is no such frame
+  int d = ftrace_depth;
+  while (d > 0 && ftrace_stack[d - 1].ret != to) d --;
+  if (d > 0) ftrace_depth = d - 1;
+  else if (ftrace_depth > 0) ftrace_depth --;
+}
+
+static void stack_tail(vaddr_t to) {
+  // an indirect jump is a tail call only when it goes to another function
+  vaddr_t start;
+  if (nr_lost > 0 || ftrace_depth == 0 || symtab_func(to, &start) == NULL || start != to) return;
+  ftrace_stack[ftrace_depth - 1].func = to;
+}
+
+/* trace */
+
+void ftrace_push(int kind, vaddr_t from, vaddr_t to) {
+  // the instructions replayed for reverse execution are traced before
+  if (MUXDEF(CONFIG_REVERSE, reverse_replaying, false)) return;
+  switch (kind) {
+    // instructions are 4 bytes long, since the C extension is not supported
+    case FTRACE_CALL: stack_call(to, from + 4); break;
+    case FTRACE_RET:  stack_ret(to); break;
+    case FTRACE_TAIL: stack_tail(to); break;
+  }
+  if (fp == NULL) return;
+  uint64_t tail = ring_tail;
+  while (tail - __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE) == RING_SIZE) sched_yield();
+  ring[tail & RING_MASK] = (FtraceRecord) {
+    .instr = g_nr_guest_instr | (uint64_t)kind << 56, .from = from, .to = to };
+  __atomic_store_n(&ring_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// wait for the writer to drain the ring, and close the trace with FTRACE_END
+void ftrace_flush() {
+  if (fp == NULL) return;
+  ftrace_push(FTRACE_END, cpu.pc, cpu.pc);
+  while (__atomic_load_n(&ring_head, __ATOMIC_ACQUIRE) != ring_tail) sched_yield();
+  fflush(fp);
+  fp = NULL;
+}
+#endif
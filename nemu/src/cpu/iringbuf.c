@@ -0,0 +1,69 @@
+#include <cpu/iringbuf.h>
+
+#ifdef CONFIG_IRINGBUF
+static_assert((CONFIG_IRINGBUF_SIZE & IRINGBUF_MASK) == 0, "the size of the ring should be a power of 2");
+
+IRingEntry iringbuf[CONFIG_IRINGBUF_SIZE];
+uint64_t iringbuf_nr = 0;
+
+static FILE *fp = NULL;
+static uint64_t nr_written = 0;
+
+void init_iringbuf(const char *file, const char *triple) {
+  if (file == NULL) return;
+  fp = fopen(file, "w");
+  Assert(fp, "Can not open '%s'", file);
+  static char buf[1 << 20];
+  setvbuf(fp, buf, _IOFBF, sizeof(buf));
+  struct {
+    uint64_t magic;
+    char triple[32];
+  } h = { .magic = IRINGBUF_MAGIC };
+  strncpy(h.triple, triple, sizeof(h.triple) - 1);
+  int ret = fwrite(&h, sizeof(h), 1, fp);
+  assert(ret == 1);
+  atexit(iringbuf_flush);
+  Log("Instruction trace is written to %s", file);
+}
+
+// write the entries not written yet, which never wrap around
+static void write_entries() {
+  uint64_t n = iringbuf_nr - nr_written;
+  if (n == 0) return;
+  int ret = fwrite(&iringbuf[nr_written & IRINGBUF_MASK], sizeof(iringbuf[0]), n, fp);
+  assert(ret == n);
+  nr_written = iringbuf_nr;
+}
+
+// called when the ring is full
+void iringbuf_full() {
+  if (fp != NULL) write_entries();
+}
+
+void iringbuf_flush() {
+  if (fp == NULL) return;
+  write_entries();
+  fflush(fp);
+}
+
+void iringbuf_dump() {
+  uint64_t n = CONFIG_IRINGBUF_DUMP;
+  if (n > CONFIG_IRINGBUF_SIZE) n = CONFIG_IRINGBUF_SIZE;
+  if (n > iringbuf_nr) n = iringbuf_nr;
+  if (n == 0) return;
+  printf("The last %ld instructions executed:\n", n);
+  uint64_t i;
+  for (i = iringbuf_nr - n; i < iringbuf_nr; i ++) {
+    IRingEntry *e = &iringbuf[i & IRINGBUF_MASK];
+    char buf[128];
+#ifdef CONFIG_ITRACE
+    void disassemble(char *str, int size, uint64_t pc, uint8_t *code, int nbyte);
+    disassemble(buf, sizeof(buf), e->pc, (uint8_t *)&e->instr, e->ilen);
+#else
+    buf[0] = '\0';
+#endif
+    printf("%s" FMT_WORD ": %08x  %s\n", (i == iringbuf_nr - 1 ? " --> " : "     "),
+        (vaddr_t)e->pc, e->instr, buf);
+  }
+}
+#endif
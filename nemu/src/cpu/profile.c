@@ -0,0 +1,174 @@
+#include <isa.h>
+#include <cpu/ftrace.h>
+#include <cpu/profile.h>
+
+#ifdef CONFIG_PROFILE
+// The profiler samples the guest every CONFIG_PROFILE_INTERVAL instructions.
+// A sample is the shadow call stack of ftrace plus the function being
+// executed, and the samples with the same stack are counted together in a
+// hash table. At exit, the flat profile of the functions is written to the
+// file given by --profile, and the stacks are written to FILE.folded in the
+// folded format of flame graphs.
+//
+// Without the symbol table from --elf, the pc itself is taken as the
+// function being executed, and functions are named by their addresses.
+
+typedef struct {
+  uint64_t count;
+  uint32_t hash;
+  uint32_t len;
+  vaddr_t *frame; // the outermost first
+} Stack;
+
+typedef struct {
+  vaddr_t addr;
+  uint64_t self, total;
+  uint32_t last; // the last stack counted in `total', to skip recursion
+} FuncStat;
+
+uint64_t profile_budget = -1; // never sample without --profile
+
+static const char *profile_file = NULL;
+static Stack *table = NULL;
+static uint32_t nr_slot = 0, nr_stack = 0;
+static uint64_t nr_sample = 0;
+
+static uint32_t hash_frames(const vaddr_t *frame, int len) {
+  uint32_t h = 2166136261u; // FNV-1a
+  int i;
+  for (i = 0; i < len; i ++) h = (h ^ (uint32_t)(frame[i] >> 2)) * 16777619u;
+  return h;
+}
+
+static Stack* find_slot(Stack *t, uint32_t mask, uint32_t hash, const vaddr_t *frame, int len) {
+  uint32_t i = hash & mask;
+  while (t[i].frame != NULL) {
+    if (t[i].hash == hash && t[i].len == len &&
+        memcmp(t[i].frame, frame, sizeof(frame[0]) * len) == 0) break;
+    i = (i + 1) & mask;
+  }
+  return &t[i];
+}
+
+static void grow() {
+  uint32_t n = nr_slot * 2, i;
+  Stack *t = calloc(n, sizeof(Stack));
+  assert(t);
+  for (i = 0; i < nr_slot; i ++) {
+    Stack *s = &table[i];
+    if (s->frame != NULL) *find_slot(t, n - 1, s->hash, s->frame, s->len) = *s;
+  }
+  free(table);
+  table = t;
+  nr_slot = n;
+}
+
+void profile_sample() {
+  profile_budget = CONFIG_PROFILE_INTERVAL;
+  static vaddr_t frame[FTRACE_STACK_MAX + 1];
+  int len = ftrace_depth, i;
+  for (i = 0; i < len; i ++) frame[i] = ftrace_stack[i].func;
+  vaddr_t leaf;
+  if (symtab_func(cpu.pc, &leaf) == NULL) leaf = cpu.pc;
+  if (len == 0 || frame[len - 1] != leaf) frame[len ++] = leaf;
+
+  uint32_t hash = hash_frames(frame, len);
+  Stack *s = find_slot(table, nr_slot - 1, hash, frame, len);
+  if (s->frame == NULL) {
+    s->frame = malloc(sizeof(frame[0]) * len);
+    assert(s->frame);
+    memcpy(s->frame, frame, sizeof(frame[0]) * len);
+    s->hash = hash;
+    s->len = len;
+    nr_stack ++;
+  }
+  s->count ++;
+  nr_sample ++;
+  if (nr_stack * 2 > nr_slot) grow();
+}
+
+/* output */
+
+static const char* func_name(vaddr_t addr) {
+  static char buf[32];
+  vaddr_t start;
+  const char *name = symtab_func(addr, &start);
+  if (name != NULL && start == addr) return name;
+  snprintf(buf, sizeof(buf), FMT_WORD, addr);
+  return buf;
+}
+
+static int cmp_self(const void *a, const void *b) {
+  const FuncStat *x = a, *y = b;
+  if (x->self != y->self) return (x->self < y->self) - (x->self > y->self);
+  return (x->total < y->total) - (x->total > y->total);
+}
+
+static void write_folded() {
+  char file[256];
+  snprintf(file, sizeof(file), "%s.folded", profile_file);
+  FILE *fp = fopen(file, "w");
+  Assert(fp, "Can not open '%s'", file);
+  uint32_t i, j;
+  for (i = 0; i < nr_slot; i ++) {
+    Stack *s = &table[i];
+    if (s->frame == NULL) continue;
+    for (j = 0; j < s->len; j ++) fprintf(fp, "%s%s", (j ? ";" : ""), func_name(s->frame[j]));
+    fprintf(fp, " %lu\n", s->count);
+  }
+  fclose(fp);
+}
+
+static void write_flat() {
+  // count the functions in a hash table keyed by their addresses
+  uint32_t nr_frame = 0, n = 16, i, j;
+  for (i = 0; i < nr_slot; i ++) nr_frame += table[i].len;
+  while (n < 2 * nr_frame) n *= 2;
+  FuncStat *f = calloc(n, sizeof(FuncStat));
+  assert(f);
+  for (i = 0; i < nr_slot; i ++) {
+    Stack *s = &table[i];
+    for (j = 0; j < s->len; j ++) {
+      uint32_t k = hash_frames(&s->frame[j], 1) & (n - 1);
+      while (f[k].total != 0 && f[k].addr != s->frame[j]) k = (k + 1) & (n - 1);
+      f[k].addr = s->frame[j];
+      if (j == s->len - 1) f[k].self += s->count;
+      if (f[k].total == 0 || f[k].last != i) f[k].total += s->count;
+      f[k].last = i;
+    }
+  }
+  for (i = j = 0; i < n; i ++) if (f[i].total != 0) f[j ++] = f[i];
+  qsort(f, j, sizeof(FuncStat), cmp_self);
+
+  FILE *fp = fopen(profile_file, "w");
+  Assert(fp, "Can not open '%s'", profile_file);
+  fprintf(fp, "Flat profile: %lu samples, one every %d instructions\n\n",
+      nr_sample, CONFIG_PROFILE_INTERVAL);
+  fprintf(fp, "%7s %12s %7s %12s  %s\n", "self%", "self", "total%", "total", "function");
+  for (i = 0; i < j; i ++) {
+    fprintf(fp, "%6.2f%% %12lu %6.2f%% %12lu  %s\n",
+        100.0 * f[i].self / nr_sample, f[i].self,
+        100.0 * f[i].total / nr_sample, f[i].total, func_name(f[i].addr));
+  }
+  fclose(fp);
+  free(f);
+}
+
+static void profile_dump() {
+  if (nr_sample == 0) return;
+  write_flat();
+  write_folded();
+  Log("Profile of %lu samples is written to %s and %s.folded", nr_sample, profile_file, profile_file);
+}
+
+void init_profile(const char *file) {
+  if (file == NULL) return;
+  profile_file = file;
+  profile_budget = CONFIG_PROFILE_INTERVAL;
+  nr_slot = 1024;
+  table = calloc(nr_slot, sizeof(Stack));
+  assert(table);
+  atexit(profile_dump);
+  Log("Sample the guest every %d instructions", CONFIG_PROFILE_INTERVAL);
+}
+#endif
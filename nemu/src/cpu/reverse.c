@@ -0,0 +1,342 @@
+#include <isa.h>
+#include <cpu/cpu.h>
+#include <cpu/reverse.h>
+#include <memory/paddr.h>
+#include <memory/vaddr.h>
+
+#ifdef CONFIG_REVERSE
+// Reverse execution goes back by restoring a snapshot and executing the
+// instructions after it again.
+//
+// A snapshot is taken every `interval` instructions. It saves the CPU
+// state, and the old content of each page of pmem before the page is
+// first written since the snapshot. Restoring a snapshot undoes the pages
+// saved by it and all the later snapshots, from the newest to the oldest.
+//
+// The values read from device registers and the interrupts taken are
+// logged, so that running the same instructions again gives the same
+// result. While replaying, devices are not touched at all: the values read
+// come from the log, and writes to device registers are dropped, since
+// the devices have already seen them. NEMU goes back to the normal mode
+// after reaching the furthest point executed (the frontier).
+//
+// When the saved pages take more memory than CONFIG_REVERSE_MEM_LIMIT,
+// every two adjacent snapshots are merged and the interval is doubled.
+// If the pages and the event log together still take more than the limit,
+// the oldest snapshots and the events before them are forgotten.
+//
+// If the guest does not run as logged when replaying, e.g. it reads pages
+// written by DMA or device memory which are not saved, the log after that
+// point is dropped, and the guest stops there and runs with the devices
+// from then on.
+
+typedef struct {
+  paddr_t addr;
+  uint8_t data[PAGE_SIZE];
+} SavedPage;
+
+typedef struct {
+  uint64_t instr;   // number of instructions executed when taken
+  CPU_state cpu;
+  uint64_t log_idx; // the first event after the snapshot
+  SavedPage **page;
+  uint32_t nr_page, max_page;
+} Snapshot;
+
+enum { EV_INPUT, EV_INTR };
+
+typedef struct {
+  uint64_t instr;  // number of instructions executed before the event
+  paddr_t addr;    // address of the device register read
+  word_t data;     // value read, or the interrupt number
+  int kind;
+} Event;
+
+#define MEM_LIMIT ((uint64_t)CONFIG_REVERSE_MEM_LIMIT << 20)
+#define NR_PAGE (CONFIG_MSIZE / PAGE_SIZE)
+
+extern uint64_t g_nr_guest_instr;
+void cpu_exec_seek(uint64_t target, void (*check)(vaddr_t dnpc));
+
+bool reverse_replaying = false;
+static uint64_t frontier = 0;
+static uint64_t interval = CONFIG_REVERSE_INTERVAL;
+
+static Snapshot *snap = NULL;
+static int nr_snap = 0, max_snap = 0;
+static uint64_t saved_bytes = 0;
+
+static Event *ev = NULL;
+static uint64_t nr_event = 0, max_event = 0;
+static uint64_t replay_idx = 0;
+static bool diverged = false;
+
+#define GROW(array, nr, max) do { \
+  if ((nr) == (max)) { \
+    (max) = ((max) == 0 ? 64 : (max) * 2); \
+    (array) = realloc((array), sizeof((array)[0]) * (max)); \
+    assert(array); \
+  } \
+} while (0)
+
+/* snapshots */
+
+static uint64_t used_bytes() {
+  return saved_bytes + nr_event * sizeof(Event);
+}
+
+static void save_page(paddr_t page) {
+  Snapshot *s = &snap[nr_snap - 1];
+  GROW(s->page, s->nr_page, s->max_page);
+  SavedPage *p = malloc(sizeof(*p));
+  assert(p);
+  p->addr = page;
+  memcpy(p->data, guest_to_host(page), PAGE_SIZE);
+  s->page[s->nr_page ++] = p;
+  saved_bytes += sizeof(*p);
+}
+
+static void free_pages(Snapshot *s) {
+  int i;
+  for (i = 0; i < s->nr_page; i ++) free(s->page[i]);
+  saved_bytes -= (uint64_t)s->nr_page * sizeof(SavedPage);
+  s->nr_page = 0;
+}
+
+// `dst` is older than `src`, so its copy of a page wins
+static void merge(Snapshot *dst, Snapshot *src) {
+  static uint8_t saved[NR_PAGE] = {};
+  int i;
+  for (i = 0; i < dst->nr_page; i ++) saved[(dst->page[i]->addr - CONFIG_MBASE) / PAGE_SIZE] = 1;
+  for (i = 0; i < src->nr_page; i ++) {
+    SavedPage *p = src->page[i];
+    if (saved[(p->addr - CONFIG_MBASE) / PAGE_SIZE]) {
+      free(p);
+      saved_bytes -= sizeof(*p);
+      continue;
+    }
+    GROW(dst->page, dst->nr_page, dst->max_page);
+    dst->page[dst->nr_page ++] = p;
+  }
+  for (i = 0; i < dst->nr_page; i ++) saved[(dst->page[i]->addr - CONFIG_MBASE) / PAGE_SIZE] = 0;
+  free(src->page);
+}
+
+static void drop_oldest() {
+  free_pages(&snap[0]);
+  free(snap[0].page);
+  nr_snap --;
+  memmove(snap, snap + 1, sizeof(snap[0]) * nr_snap);
+
+  // the events before the new oldest snapshot are never replayed again
+  uint64_t base = snap[0].log_idx;
+  int i;
+  nr_event -= base;
+  memmove(ev, ev + base, sizeof(ev[0]) * nr_event);
+  for (i = 0; i < nr_snap; i ++) snap[i].log_idx -= base;
+  replay_idx -= base;
+  if (nr_event < max_event / 4) {
+    max_event /= 2;
+    ev = realloc(ev, sizeof(ev[0]) * max_event);
+    assert(ev);
+  }
+}
+
+static void thin_out() {
+  int i, n = 0;
+  for (i = 0; i < nr_snap; i += 2) {
+    if (i + 1 < nr_snap) merge(&snap[i], &snap[i + 1]);
+    snap[n ++] = snap[i];
+  }
+  nr_snap = n;
+  interval *= 2;
+  Log("reverse: snapshots take %ld KB after thinning out, now taken every %ld instructions",
+      saved_bytes >> 10, interval);
+}
+
+static void take_snapshot() {
+  if (nr_snap == 0) pmem_track_writes(save_page);
+  // keep the snapshots fixed while going backwards, since the memory
+  // taken is bounded by the run before anyway
+  else if (used_bytes() > MEM_LIMIT && !reverse_replaying) {
+    if (saved_bytes > MEM_LIMIT) thin_out();
+    while (used_bytes() > MEM_LIMIT && nr_snap > 1) drop_oldest();
+  }
+  pmem_track_reset();
+
+  GROW(snap, nr_snap, max_snap);
+  Snapshot *s = &snap[nr_snap ++];
+  s->instr = g_nr_guest_instr;
+  s->cpu = cpu;
+  s->log_idx = (reverse_replaying ? replay_idx : nr_event);
+  s->page = NULL;
+  s->nr_page = s->max_page = 0;
+}
+
+// undo the pages saved by snapshot k and the later ones
+static void restore(int k) {
+  int i, j;
+  for (i = nr_snap - 1; i >= k; i --) {
+    Snapshot *s = &snap[i];
+    for (j = s->nr_page - 1; j >= 0; j --) {
+      memcpy(guest_to_host(s->page[j]->addr), s->page[j]->data, PAGE_SIZE);
+    }
+    free_pages(s);
+    if (i > k) free(s->page);
+  }
+  nr_snap = k + 1;
+  pmem_track_reset();
+
+  if (!reverse_replaying) {
+    frontier = g_nr_guest_instr;
+    reverse_replaying = true;
+  }
+  cpu = snap[k].cpu;
+  g_nr_guest_instr = snap[k].instr;
+  replay_idx = snap[k].log_idx;
+  if (nemu_state.state == NEMU_END || nemu_state.state == NEMU_ABORT) nemu_state.state = NEMU_STOP;
+}
+
+/* event log */
+
+void reverse_record_input(paddr_t addr, word_t data) {
+  GROW(ev, nr_event, max_event);
+  ev[nr_event ++] = (Event){ .instr = g_nr_guest_instr, .addr = addr, .data = data, .kind = EV_INPUT };
+}
+
+void reverse_record_intr(word_t NO) {
+  GROW(ev, nr_event, max_event);
+  ev[nr_event ++] = (Event){ .instr = g_nr_guest_instr, .data = NO, .kind = EV_INTR };
+}
+
+// the rest of the log is useless, so run with the devices from here
+static void replay_diverge() {
+  printf("reverse: the guest does not run as logged at instruction #%ld, pc = " FMT_WORD
+      ", stop replaying here\n", g_nr_guest_instr, cpu.pc);
+  nr_event = replay_idx;
+  frontier = g_nr_guest_instr;
+  reverse_replaying = false;
+  diverged = true;
+  cpu_kick_intr_check();
+  if (nemu_state.state == NEMU_RUNNING) nemu_state.state = NEMU_STOP;
+}
+
+// return false if the access is not in the log, in which case
+// the devices should be accessed
+bool reverse_replay_input(paddr_t addr, word_t *data) {
+  if (replay_idx < nr_event && ev[replay_idx].kind == EV_INPUT &&
+      ev[replay_idx].addr == addr && ev[replay_idx].instr == g_nr_guest_instr) {
+    *data = ev[replay_idx ++].data;
+    return true;
+  }
+  replay_diverge();
+  return false;
+}
+
+static void replay_intr() {
+  while (replay_idx < nr_event && ev[replay_idx].kind == EV_INTR &&
+      ev[replay_idx].instr == g_nr_guest_instr) {
+    cpu.pc = isa_raise_intr(ev[replay_idx].data, cpu.pc);
+    replay_idx ++;
+  }
+}
+
+void reverse_before_instr() {
+  if (unlikely(reverse_replaying)) {
+    replay_intr();
+    if (g_nr_guest_instr >= frontier) {
+      if (replay_idx != nr_event) replay_diverge();
+      else {
+        reverse_replaying = false;
+        cpu_kick_intr_check();
+      }
+    }
+  }
+  if (unlikely(nr_snap == 0 || g_nr_guest_instr - snap[nr_snap - 1].instr >= interval)) {
+    take_snapshot();
+  }
+}
+
+/* sdb interface */
+
+#ifdef CONFIG_WATCHPOINT
+bool wp_update(bool display);
+#endif
+bool bp_match(vaddr_t pc);
+
+static void sync_watchpoints() {
+  IFDEF(CONFIG_WATCHPOINT, wp_update(false));
+}
+
+static int find_snapshot(uint64_t instr) {
+  int k = nr_snap - 1;
+  while (k > 0 && snap[k].instr > instr) k --;
+  return k;
+}
+
+static void report() {
+  printf("Reverse to instruction #%ld at pc = " FMT_WORD "\n", g_nr_guest_instr, cpu.pc);
+}
+
+void reverse_step(uint64_t n) {
+  if (nr_snap == 0 || n == 0) return;
+  uint64_t target = g_nr_guest_instr - n;
+  if (n > g_nr_guest_instr - snap[0].instr) {
+    target = snap[0].instr;
+    printf("Only %ld instructions can be reversed\n", g_nr_guest_instr - snap[0].instr);
+  }
+  restore(find_snapshot(target));
+  diverged = false;
+  cpu_exec_seek(target, NULL);
+  sync_watchpoints();
+  report();
+}
+
+static uint64_t scan_end = 0, last_stop = 0;
+static bool found = false;
+
+static void note_stop(vaddr_t dnpc) {
+  bool stop = false;
+  IFDEF(CONFIG_WATCHPOINT, stop |= wp_update(false));
+  stop |= bp_match(dnpc);
+  if (stop && g_nr_guest_instr < scan_end) {
+    last_stop = g_nr_guest_instr;
+    found = true;
+  }
+}
+
+// Go back to the last place where a watchpoint or a breakpoint would have
+// stopped the guest. The intervals between snapshots are scanned from the
+// newest to the oldest.
+void reverse_continue() {
+  if (nr_snap == 0) return;
+  scan_end = g_nr_guest_instr;
+  uint64_t end = scan_end;
+  found = false;
+  diverged = false;
+  while (end > snap[0].instr) {
+    int k = find_snapshot(end - 1);
+    uint64_t start = snap[k].instr;
+    restore(k);
+    sync_watchpoints();
+    cpu_exec_seek(end, note_stop);
+    if (diverged) {
+      sync_watchpoints();
+      report();
+      return;
+    }
+    if (found) {
+      restore(find_snapshot(last_stop));
+      cpu_exec_seek(last_stop, NULL);
+      sync_watchpoints();
+      report();
+      return;
+    }
+    end = start;
+  }
+  restore(0);
+  sync_watchpoints();
+  printf("No watchpoint or breakpoint is hit since the oldest snapshot\n");
+  report();
+}
+#endif
@@ -0,0 +1,58 @@
+#include <cpu/stat.h>
+#include <isa-all-instr.h>
+
+#ifdef CONFIG_INSTR_STAT
+// Instruction mix statistics, dumped as JSON to the file given by --stat
+// at exit, or to the screen by `info stat' in sdb.
+
+extern uint64_t g_nr_guest_instr;
+
+InstrStat g_stat = {};
+uint64_t g_stat_exec[TOTAL_INSTR] = {};
+
+#define INSTR_NAME(name) str(name),
+static const char *instr_name[TOTAL_INSTR] = { MAP(INSTR_LIST, INSTR_NAME) };
+
+static const char *stat_file = NULL;
+
+static void dump_width(FILE *fp, const char *name, uint64_t *count) {
+  uint64_t bytes = 0;
+  int i;
+  fprintf(fp, "  \"%s\": {", name);
+  for (i = 0; i < 4; i ++) {
+    fprintf(fp, "\"%d\": %lu, ", 1 << i, count[i]);
+    bytes += count[i] << i;
+  }
+  fprintf(fp, "\"bytes\": %lu},\n", bytes);
+}
+
+void stat_dump(FILE *fp) {
+  int i;
+  fprintf(fp, "{\n  \"instructions\": %lu,\n  \"exec\": {", g_nr_guest_instr);
+  for (i = 0; i < TOTAL_INSTR; i ++) {
+    fprintf(fp, "%s\"%s\": %lu", (i ? ", " : ""), instr_name[i], g_stat_exec[i]);
+  }
+  fprintf(fp, "},\n");
+  dump_width(fp, "load", g_stat.load);
+  dump_width(fp, "store", g_stat.store);
+  fprintf(fp, "  \"branch\": {\"taken\": %lu, \"not_taken\": %lu},\n",
+      g_stat.branch[1], g_stat.branch[0]);
+  uint64_t nr_access = 0;
+  for (i = 0; i < 4; i ++) nr_access += g_stat.load[i] + g_stat.store[i];
+  fprintf(fp, "  \"access\": {\"ram\": %lu, \"mmio\": %lu}\n}\n",
+      nr_access - g_stat.mmio, g_stat.mmio);
+}
+
+void stat_set_file(const char *file) {
+  stat_file = file;
+}
+
+void stat_write() {
+  if (stat_file == NULL) return;
+  FILE *fp = fopen(stat_file, "w");
+  Assert(fp, "Can not open '%s'", stat_file);
+  stat_dump(fp);
+  fclose(fp);
+  Log("Instruction statistics are written to %s", stat_file);
+}
+#endif
@@ -28,5 +28,5 @@ void init_audio() {
 #endif
 
   sbuf = (uint8_t *)new_space(CONFIG_SB_SIZE);
-  add_mmio_map("audio-sbuf", CONFIG_SB_ADDR, sbuf, CONFIG_SB_SIZE, NULL);
+  add_mmio_mem("audio-sbuf", CONFIG_SB_ADDR, sbuf, CONFIG_SB_SIZE);
 }
@@ -0,0 +1,55 @@
+#include <device/map.h>
+#include <cpu/cpu.h>
+
+// core-local interruptor with the SiFive register layout.
+// `mtime` is driven by the number of guest instructions executed,
+// which makes timer interrupts deterministic.
+
+#define CLINT_MSIP     0x0000
+#define CLINT_MTIMECMP 0x4000
+#define CLINT_MTIME    0xbff8
+#define CLINT_SIZE     0x10000
+
+extern uint64_t g_nr_guest_instr;
+
+static uint8_t *clint_base = NULL;
+
+#define msip     (*(uint32_t *)(clint_base + CLINT_MSIP))
+#define mtimecmp (*(uint64_t *)(clint_base + CLINT_MTIMECMP))
+#define mtime    (*(uint64_t *)(clint_base + CLINT_MTIME))
+
+static uint64_t get_mtime() {
+  return g_nr_guest_instr / CONFIG_CLINT_INSTR_PER_TICK;
+}
+
+bool clint_msip() {
+  return msip & 1;
+}
+
+bool clint_mtip() {
+  return get_mtime() >= mtimecmp;
+}
+
+// the number of instructions to execute before `mtime` reaches `mtimecmp`
+uint64_t clint_instr_to_deadline() {
+  if (clint_mtip()) return UINT64_MAX;
+  uint64_t deadline = mtimecmp * CONFIG_CLINT_INSTR_PER_TICK;
+  if (deadline / CONFIG_CLINT_INSTR_PER_TICK != mtimecmp) return UINT64_MAX; // overflow
+  return deadline - g_nr_guest_instr;
+}
+
+static void clint_io_handler(uint32_t offset, int len, bool is_write) {
+  if (offset >= CLINT_MTIME && offset < CLINT_MTIME + 8) {
+    if (!is_write) mtime = get_mtime();
+  } else if (offset < CLINT_MTIMECMP + 8 && is_write) {
+    // msip or mtimecmp is changed
+    cpu_kick_intr_check();
+  }
+}
+
+void init_clint() {
+  clint_base = new_space(CLINT_SIZE);
+  memset(clint_base, 0, CLINT_SIZE);
+  mtimecmp = UINT64_MAX;
+  add_mmio_map("clint", CONFIG_CLINT_MMIO, clint_base, CLINT_SIZE, clint_io_handler);
+}
@@ -1,6 +1,8 @@
 #include <common.h>
 #include <utils.h>
 #include <device/alarm.h>
+#include <device/mmio.h>
+#include <device/map.h>
 #ifndef CONFIG_TARGET_AM
 #include <SDL2/SDL.h>
 #endif
@@ -13,10 +15,18 @@ void init_i8042();
 void init_audio();
 void init_disk();
 void init_sdcard();
+void init_virtio_blk();
+void init_virtio_console();
+void init_net();
 void init_alarm();
+void init_clint();
+void init_plic();
 
 void send_key(uint8_t, bool);
 void vga_update_screen();
+void serial_update();
+void disk_update();
+void net_update();
 
 void device_update() {
   static uint64_t last = 0;
@@ -26,7 +36,11 @@ void device_update() {
   }
   last = now;
 
+  mmio_flush();
   IFDEF(CONFIG_HAS_VGA, vga_update_screen());
+  IFDEF(CONFIG_HAS_SERIAL, serial_update());
+  IFDEF(CONFIG_HAS_DISK, disk_update());
+  IFDEF(CONFIG_HAS_NET, net_update());
 
 #ifndef CONFIG_TARGET_AM
   SDL_Event event;
@@ -58,10 +72,20 @@ void sdl_clear_event_queue() {
 #endif
 }
 
+// The registers of a device which is not enabled. They read 0, which
+// tells the guest that the device is absent.
+static void __attribute__((unused)) init_absent(const char *name, paddr_t addr, int nr_reg) {
+  uint32_t *base = (uint32_t *)new_space(sizeof(uint32_t) * nr_reg);
+  memset(base, 0, sizeof(uint32_t) * nr_reg);
+  add_mmio_map(name, addr, base, sizeof(uint32_t) * nr_reg, NULL);
+}
+
 void init_device() {
   IFDEF(CONFIG_TARGET_AM, ioe_init());
   init_map();
 
+  IFDEF(CONFIG_HAS_CLINT, init_clint());
+  IFDEF(CONFIG_HAS_PLIC, init_plic());
   IFDEF(CONFIG_HAS_SERIAL, init_serial());
   IFDEF(CONFIG_HAS_TIMER, init_timer());
   IFDEF(CONFIG_HAS_VGA, init_vga());
@@ -69,6 +93,11 @@ void init_device() {
   IFDEF(CONFIG_HAS_AUDIO, init_audio());
   IFDEF(CONFIG_HAS_DISK, init_disk());
   IFDEF(CONFIG_HAS_SDCARD, init_sdcard());
+  IFDEF(CONFIG_HAS_VIRTIO, init_virtio_blk());
+  IFDEF(CONFIG_HAS_VIRTIO, init_virtio_console());
+  // only `present' of the network card, and up to `memsz' of the 2D accelerator
+  MUXDEF(CONFIG_HAS_NET, init_net(), init_absent("net", CONFIG_NET_CTL_MMIO, 1));
+  IFNDEF(CONFIG_VGA_ACCEL, init_absent("gpuctl", CONFIG_GPU_CTL_MMIO, 6));
 
   IFNDEF(CONFIG_TARGET_AM, init_alarm());
 }
@@ -1,4 +1,138 @@
 #include <device/map.h>
+#include <device/intr.h>
+#include <memory/paddr.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+// A simple block device. The guest fills in `buf`, `blkno` and `count`,
+// and starts a request by writing `cmd`. The request is served by a worker
+// thread with pread/pwrite directly on the guest memory, so the guest can
+// continue running until `status` becomes ready again. A bad request is
+// ignored with `status` set to error. A request sent while the disk is busy
+// is dropped, and `status` keeps reporting the request being served.
+
+#define BLKSZ 512
+
+enum {
+  reg_present,
+  reg_blksz,
+  reg_blkcnt,
+  reg_cmd,
+  reg_buf,
+  reg_blkno,
+  reg_count,
+  reg_status,
+  nr_reg
+};
+
+enum { DISK_CMD_NONE, DISK_CMD_READ, DISK_CMD_WRITE };
+enum { DISK_BUSY, DISK_READY, DISK_ERROR };
+
+static uint32_t *disk_base = NULL;
+static int disk_fd = -1;
+
+static struct {
+  int cmd;
+  paddr_t buf;
+  uint32_t blkno, count;
+} req;
+static bool has_req = false;
+static bool intr_pending = false;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+
+static bool disk_rw(int cmd, uint8_t *buf, off_t offset, size_t len) {
+  while (len > 0) {
+    ssize_t ret = (cmd == DISK_CMD_WRITE ? pwrite(disk_fd, buf, len, offset) :
+        pread(disk_fd, buf, len, offset));
+    if (ret <= 0) return false;
+    buf += ret;
+    offset += ret;
+    len -= ret;
+  }
+  return true;
+}
+
+static void* disk_worker(void *arg) {
+  pthread_mutex_lock(&lock);
+  while (true) {
+    while (!has_req) pthread_cond_wait(&cond, &lock);
+    pthread_mutex_unlock(&lock);
+
+    bool ok = disk_rw(req.cmd, guest_to_host(req.buf),
+        (off_t)req.blkno * BLKSZ, (size_t)req.count * BLKSZ);
+
+    pthread_mutex_lock(&lock);
+    has_req = false;
+    __atomic_store_n(&disk_base[reg_status], (ok ? DISK_READY : DISK_ERROR), __ATOMIC_RELEASE);
+    __atomic_store_n(&intr_pending, true, __ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+static void disk_io_handler(uint32_t offset, int len, bool is_write) {
+  if (!is_write || offset != reg_cmd * sizeof(uint32_t)) return;
+  int cmd = disk_base[reg_cmd];
+  disk_base[reg_cmd] = DISK_CMD_NONE;
+  if (cmd == DISK_CMD_NONE) return;
+
+  paddr_t buf = disk_base[reg_buf];
+  uint32_t blkno = disk_base[reg_blkno];
+  uint32_t count = disk_base[reg_count];
+  uint32_t blkcnt = disk_base[reg_blkcnt];
+  bool ok = disk_fd >= 0 && (cmd == DISK_CMD_READ || cmd == DISK_CMD_WRITE) &&
+    count != 0 && count <= blkcnt && blkno <= blkcnt - count &&
+    (uint64_t)count * BLKSZ <= CONFIG_MSIZE &&
+    in_pmem(buf) && in_pmem(buf + count * BLKSZ - 1);
+
+  pthread_mutex_lock(&lock);
+  if (!ok || has_req) {
+    if (!has_req) disk_base[reg_status] = DISK_ERROR;
+    pthread_mutex_unlock(&lock);
+    return;
+  }
+  req.cmd = cmd;
+  req.buf = buf;
+  req.blkno = blkno;
+  req.count = count;
+  has_req = true;
+  disk_base[reg_status] = DISK_BUSY;
+  pthread_cond_signal(&cond);
+  pthread_mutex_unlock(&lock);
+}
+
+void disk_update() {
+  if (__atomic_load_n(&intr_pending, __ATOMIC_ACQUIRE)) {
+    __atomic_store_n(&intr_pending, false, __ATOMIC_RELAXED);
+    dev_raise_intr(IRQ_DISK);
+  }
+}
 
 void init_disk() {
+  uint32_t space_size = sizeof(uint32_t) * nr_reg;
+  disk_base = (uint32_t *)new_space(space_size);
+#ifdef CONFIG_HAS_PORT_IO
+  add_pio_map ("disk", CONFIG_DISK_CTL_PORT, disk_base, space_size, disk_io_handler);
+#else
+  add_mmio_map("disk", CONFIG_DISK_CTL_MMIO, disk_base, space_size, disk_io_handler);
+#endif
+
+  disk_base[reg_present] = false;
+  disk_base[reg_blksz] = BLKSZ;
+  disk_base[reg_blkcnt] = 0;
+  disk_base[reg_status] = DISK_READY;
+
+  const char *img = CONFIG_DISK_IMG_PATH;
+  disk_fd = open(img, O_RDWR);
+  if (disk_fd < 0) { Log("Can not find disk image: %s", img); return; }
+  off_t size = lseek(disk_fd, 0, SEEK_END);
+  disk_base[reg_present] = true;
+  disk_base[reg_blkcnt] = size / BLKSZ;
+  Log("Disk image %s, %d blocks", img, disk_base[reg_blkcnt]);
+
+  pthread_t worker;
+  int ret = pthread_create(&worker, NULL, disk_worker, NULL);
+  Assert(ret == 0, "Can not create disk worker thread");
+  pthread_detach(worker);
 }
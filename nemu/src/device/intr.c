@@ -1,4 +1,35 @@
 #include <isa.h>
+#include <cpu/cpu.h>
+#include <device/intr.h>
 
-void dev_raise_intr() {
+// Pending interrupts are not checked after every instruction. The CPU only
+// calls dev_intr_update() when its budget runs out, or when it is kicked
+// by a device. The budget never goes beyond the next timer deadline, so
+// timer interrupts are still taken precisely.
+#define INTR_CHECK_INTERVAL 1024
+
+void plic_raise(int irq);
+bool plic_meip();
+bool clint_msip();
+bool clint_mtip();
+uint64_t clint_instr_to_deadline();
+
+void dev_raise_intr(int irq) {
+  assert(irq > IRQ_NONE && irq < NR_IRQ);
+  IFDEF(CONFIG_HAS_PLIC, plic_raise(irq));
+  cpu_kick_intr_check();
+}
+
+// Refresh the interrupt lines to the CPU, and return the number of
+// instructions which can be executed before they should be refreshed again.
+uint64_t dev_intr_update() {
+  uint64_t budget = INTR_CHECK_INTERVAL;
+#ifdef CONFIG_HAS_CLINT
+  isa_set_intr_line(INTR_LINE_SOFT, clint_msip());
+  isa_set_intr_line(INTR_LINE_TIMER, clint_mtip());
+  uint64_t n = clint_instr_to_deadline();
+  if (n < budget) budget = n;
+#endif
+  IFDEF(CONFIG_HAS_PLIC, isa_set_intr_line(INTR_LINE_EXTERNAL, plic_meip()));
+  return budget;
 }
@@ -2,8 +2,9 @@
 #include <memory/host.h>
 #include <memory/vaddr.h>
 #include <device/map.h>
+#include <cpu/reverse.h>
 
-#define IO_SPACE_MAX (2 * 1024 * 1024)
+#define IO_SPACE_MAX (4 * 1024 * 1024)
 
 static uint8_t *io_space = NULL;
 static uint8_t *p_space = NULL;
@@ -41,15 +42,39 @@ word_t map_read(paddr_t addr, int len, IOMap *map) {
   assert(len >= 1 && len <= 8);
   check_bound(map, addr);
   paddr_t offset = addr - map->low;
-  invoke_callback(map->callback, offset, len, false); // prepare data to read
+  if (map->type == MAP_IO) {
+    word_t data __attribute__((unused));
+    IFDEF(CONFIG_REVERSE, if (reverse_replaying && reverse_replay_input(addr, &data)) return data);
+    IFDEF(CONFIG_DIFFTEST_BATCH, if (difftest_replay_input(addr, &data)) return data);
+    invoke_callback(map->callback, offset, len, false); // prepare data to read
+  }
   word_t ret = host_read(map->space + offset, len);
+  IFDEF(CONFIG_REVERSE, if (map->type == MAP_IO) reverse_record_input(addr, ret));
+  IFDEF(CONFIG_DIFFTEST_BATCH, if (map->type == MAP_IO) difftest_record_input(addr, ret));
   return ret;
 }
 
 void map_write(paddr_t addr, int len, word_t data, IOMap *map) {
   assert(len >= 1 && len <= 8);
   check_bound(map, addr);
+  // the device has seen the write before going backwards
+  IFDEF(CONFIG_REVERSE, if (reverse_replaying && map->type == MAP_IO) return);
+  IFDEF(CONFIG_DIFFTEST_BATCH, if (difftest_replaying && map->type == MAP_IO) return);
   paddr_t offset = addr - map->low;
   host_write(map->space + offset, len, data);
+  if (map->type == MAP_WC) {
+    // coalesce the notification until the next flush
+    if (offset < map->dirty_low) map->dirty_low = offset;
+    if (offset + len - 1 > map->dirty_high || map->dirty_high == (paddr_t)-1) map->dirty_high = offset + len - 1;
+    return;
+  }
   invoke_callback(map->callback, offset, len, true);
 }
+
+void map_flush(IOMap *map) {
+  if (map->dirty_high == (paddr_t)-1) return;
+  paddr_t low = map->dirty_low, high = map->dirty_high;
+  map->dirty_low = map->high - map->low + 1;
+  map->dirty_high = (paddr_t)-1;
+  invoke_callback(map->callback, low, high - low + 1, true);
+}
@@ -1,31 +1,76 @@
 #include <device/map.h>
+#include <memory/host.h>
+#include <cpu/stat.h>
 
-#define NR_MAP 16
+#define NR_MAP 32
 
 static IOMap maps[NR_MAP] = {};
 static int nr_map = 0;
 
+// bulk accesses usually hit the same map, e.g. drawing into vmem
+static IOMap *last_map = NULL;
+
 static IOMap* fetch_mmio_map(paddr_t addr) {
+  if (likely(last_map != NULL && map_inside(last_map, addr))) {
+    difftest_skip_ref();
+    return last_map;
+  }
   int mapid = find_mapid_by_addr(maps, nr_map, addr);
-  return (mapid == -1 ? NULL : &maps[mapid]);
+  if (mapid == -1) return NULL;
+  // the reference has no devices
+  difftest_skip_ref();
+  last_map = &maps[mapid];
+  return last_map;
 }
 
-/* device interface */
-void add_mmio_map(const char *name, paddr_t addr, void *space, uint32_t len, io_callback_t callback) {
+static inline bool is_plain_access(IOMap *map, paddr_t addr, int len) {
+  return map != NULL && map->type == MAP_MEM && addr + len - 1 <= map->high;
+}
+
+static void add_map(const char *name, int type, paddr_t addr, void *space, uint32_t len, io_callback_t callback) {
   assert(nr_map < NR_MAP);
-  maps[nr_map] = (IOMap){ .name = name, .low = addr, .high = addr + len - 1,
-    .space = space, .callback = callback };
+  maps[nr_map] = (IOMap){ .name = name, .type = type, .low = addr, .high = addr + len - 1,
+    .space = space, .callback = callback, .dirty_low = len, .dirty_high = (paddr_t)-1 };
   Log("Add mmio map '%s' at [" FMT_PADDR ", " FMT_PADDR "]",
       maps[nr_map].name, maps[nr_map].low, maps[nr_map].high);
 
   nr_map ++;
 }
 
+/* device interface */
+void add_mmio_map(const char *name, paddr_t addr, void *space, uint32_t len, io_callback_t callback) {
+  add_map(name, MAP_IO, addr, space, len, callback);
+}
+
+// plain memory is accessed directly by the bus without any callback
+void add_mmio_mem(const char *name, paddr_t addr, void *space, uint32_t len) {
+  add_map(name, MAP_MEM, addr, space, len, NULL);
+}
+
+// writes to a write-combining map only record the dirty range,
+// and `flush` is invoked once with the whole range by `mmio_flush()`
+void add_mmio_wc_map(const char *name, paddr_t addr, void *space, uint32_t len, io_callback_t flush) {
+  add_map(name, MAP_WC, addr, space, len, flush);
+}
+
+void mmio_flush() {
+  int i;
+  for (i = 0; i < nr_map; i ++) {
+    if (maps[i].type == MAP_WC) map_flush(&maps[i]);
+  }
+}
+
 /* bus interface */
 word_t mmio_read(paddr_t addr, int len) {
-  return map_read(addr, len, fetch_mmio_map(addr));
+  IFDEF(CONFIG_INSTR_STAT, g_stat.mmio ++);
+  IOMap *map = fetch_mmio_map(addr);
+  if (is_plain_access(map, addr, len)) return host_read(map->space + (addr - map->low), len);
+  return map_read(addr, len, map);
 }
 
 void mmio_write(paddr_t addr, int len, word_t data) {
-  map_write(addr, len, data, fetch_mmio_map(addr));
+  IFDEF(CONFIG_INSTR_STAT, g_stat.mmio ++);
+  IOMap *map = fetch_mmio_map(addr);
+  if (is_plain_access(map, addr, len)) { host_write(map->space + (addr - map->low), len, data); return; }
+  map_write(addr, len, data, map);
 }
@@ -6,12 +6,29 @@
 static IOMap maps[NR_MAP] = {};
 static int nr_map = 0;
 
+// port -> map, filled when the maps are registered
+static IOMap *port_table[PORT_IO_SPACE_MAX] = {};
+
+static IOMap* fetch_pio_map(ioaddr_t addr) {
+  IOMap *map = port_table[addr];
+  assert(map != NULL);
+  // the reference has no devices
+  difftest_skip_ref();
+  return map;
+}
+
 /* device interface */
 void add_pio_map(const char *name, ioaddr_t addr, void *space, uint32_t len, io_callback_t callback) {
   assert(nr_map < NR_MAP);
   assert(addr + len <= PORT_IO_SPACE_MAX);
   maps[nr_map] = (IOMap){ .name = name, .low = addr, .high = addr + len - 1,
     .space = space, .callback = callback };
+  ioaddr_t port;
+  for (port = addr; port < addr + len; port ++) {
+    Assert(port_table[port] == NULL, "port-io map '%s' overlaps with '%s' at port 0x%x",
+        name, port_table[port]->name, port);
+    port_table[port] = &maps[nr_map];
+  }
   Log("Add port-io map '%s' at [" FMT_PADDR ", " FMT_PADDR "]",
       maps[nr_map].name, maps[nr_map].low, maps[nr_map].high);
 
@@ -21,14 +38,10 @@ void add_pio_map(const char *name, ioaddr_t addr, void *space, uint32_t len, io_
 /* CPU interface */
 uint32_t pio_read(ioaddr_t addr, int len) {
   assert(addr + len - 1 < PORT_IO_SPACE_MAX);
-  int mapid = find_mapid_by_addr(maps, nr_map, addr);
-  assert(mapid != -1);
-  return map_read(addr, len, &maps[mapid]);
+  return map_read(addr, len, fetch_pio_map(addr));
 }
 
 void pio_write(ioaddr_t addr, int len, uint32_t data) {
   assert(addr + len - 1 < PORT_IO_SPACE_MAX);
-  int mapid = find_mapid_by_addr(maps, nr_map, addr);
-  assert(mapid != -1);
-  map_write(addr, len, data, &maps[mapid]);
+  map_write(addr, len, data, fetch_pio_map(addr));
 }
@@ -26,6 +26,12 @@ enum {
 #define SDL_KEYMAP(k) keymap[concat(SDL_SCANCODE_, k)] = concat(_KEY_, k);
 static uint32_t keymap[256] = {};
 
+#define _KEY_STR(k) [concat(_KEY_, k)] = str(k),
+static const char *keyname[] = {
+  [_KEY_NONE] = "NONE",
+  MAP(_KEYS, _KEY_STR)
+};
+
 static void init_keymap() {
   MAP(_KEYS, SDL_KEYMAP)
 }
@@ -34,6 +40,10 @@ static void init_keymap() {
 static int key_queue[KEY_QUEUE_LEN] = {};
 static int key_f = 0, key_r = 0;
 
+static bool key_queue_full() {
+  return (key_r + 1) % KEY_QUEUE_LEN == key_f;
+}
+
 static void key_enqueue(uint32_t am_scancode) {
   key_queue[key_r] = am_scancode;
   key_r = (key_r + 1) % KEY_QUEUE_LEN;
@@ -49,10 +59,94 @@ static uint32_t key_dequeue() {
   return key;
 }
 
+// Input scripts are text files with one key event per line:
+//   <instruction count> <down|up> <key name>
+// An event becomes visible to the guest at its first read of the data port
+// after that many instructions have been executed. Since this only depends
+// on the guest, replaying a recorded session is deterministic.
+
+extern uint64_t g_nr_guest_instr;
+
+static const char *replay_file = NULL;
+static const char *record_file = NULL;
+static FILE *replay_fp = NULL;
+static FILE *record_fp = NULL;
+
+typedef struct {
+  uint64_t instr;
+  uint32_t am_scancode;
+} KeyEvent;
+
+static KeyEvent replay_next = {};
+static bool replay_pending = false;
+
+void i8042_set_script(const char *replay, const char *record) {
+  if (replay != NULL) replay_file = replay;
+  if (record != NULL) record_file = record;
+}
+
+static int keyname2code(const char *name) {
+  int i;
+  for (i = 0; i < ARRLEN(keyname); i ++) {
+    if (keyname[i] != NULL && strcmp(keyname[i], name) == 0) return i;
+  }
+  return -1;
+}
+
+static bool replay_fetch() {
+  char line[128], dir[8], name[32];
+  uint64_t instr;
+  while (fgets(line, sizeof(line), replay_fp) != NULL) {
+    if (line[0] == '#' || line[0] == '\n') continue;
+    int ret = sscanf(line, "%lu %7s %31s", &instr, dir, name);
+    int code = (ret == 3 ? keyname2code(name) : -1);
+    bool is_keydown = (strcmp(dir, "down") == 0);
+    Assert(code > 0 && (is_keydown || strcmp(dir, "up") == 0),
+        "invalid key event in '%s': %s", replay_file, line);
+    Assert(instr >= replay_next.instr, "key events in '%s' are not sorted: %s", replay_file, line);
+    replay_next.instr = instr;
+    replay_next.am_scancode = code | (is_keydown ? KEYDOWN_MASK : 0);
+    return true;
+  }
+  return false;
+}
+
+static void replay_inject() {
+  while (replay_pending && replay_next.instr <= g_nr_guest_instr) {
+    // keep the rest of the script pending until the guest drains the queue
+    if (key_queue_full()) return;
+    key_enqueue(replay_next.am_scancode);
+    replay_pending = replay_fetch();
+  }
+}
+
+static void record_key(uint32_t am_scancode) {
+  fprintf(record_fp, "%lu %s %s\n", g_nr_guest_instr,
+      (am_scancode & KEYDOWN_MASK) ? "down" : "up", keyname[am_scancode & ~KEYDOWN_MASK]);
+  fflush(record_fp);
+}
+
+static void init_key_script() {
+  if (replay_file != NULL) {
+    replay_fp = fopen(replay_file, "r");
+    Assert(replay_fp, "Can not open '%s'", replay_file);
+    replay_pending = replay_fetch();
+    Log("Replay key events from %s", replay_file);
+  }
+  if (record_file != NULL) {
+    record_fp = fopen(record_file, "w");
+    Assert(record_fp, "Can not open '%s'", record_file);
+    Log("Record key events to %s", record_file);
+  }
+}
+
 void send_key(uint8_t scancode, bool is_keydown) {
+  // live events are ignored when replaying a script
+  if (replay_fp != NULL) return;
   if (nemu_state.state == NEMU_RUNNING && keymap[scancode] != _KEY_NONE) {
     uint32_t am_scancode = keymap[scancode] | (is_keydown ? KEYDOWN_MASK : 0);
     key_enqueue(am_scancode);
+    if (record_fp != NULL) record_key(am_scancode);
   }
 }
 #else // !CONFIG_TARGET_AM
@@ -70,6 +164,7 @@ static uint32_t *i8042_data_port_base = NULL;
 static void i8042_data_io_handler(uint32_t offset, int len, bool is_write) {
   assert(!is_write);
   assert(offset == 0);
+  IFNDEF(CONFIG_TARGET_AM, replay_inject());
   i8042_data_port_base[0] = key_dequeue();
 }
 
@@ -82,4 +177,5 @@ void init_i8042() {
   add_mmio_map("keyboard", CONFIG_I8042_DATA_MMIO, i8042_data_port_base, 4, i8042_data_io_handler);
 #endif
   IFNDEF(CONFIG_TARGET_AM, init_keymap());
+  IFNDEF(CONFIG_TARGET_AM, init_key_script());
 }
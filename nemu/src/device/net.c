@@ -0,0 +1,206 @@
+#define _GNU_SOURCE
+#include <device/map.h>
+#include <device/intr.h>
+#include <memory/paddr.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <errno.h>
+
+// A simple NIC with descriptor rings in guest memory. Packets are
+// exchanged with a peer through a local unix datagram socket, so two
+// NEMU instances on the same host can talk to each other.
+//
+// TX: the driver fills tx descriptors and moves `tx_head` forward. Writing
+//     `tx_head` rings the doorbell, and every pending descriptor is sent in
+//     one batch. The device moves `tx_tail` forward and marks them done.
+// RX: the driver posts empty buffers and moves `rx_head` forward. Received
+//     packets are written into them in batches, and `rx_tail` is moved forward.
+// An interrupt is raised every `intr_coalesce` completed packets, and the
+// remaining ones are flushed at the next device update.
+
+#define NET_MTU 1514
+#define NET_BATCH 32
+
+enum {
+  reg_present,
+  reg_mtu,
+  reg_tx_ring,
+  reg_tx_num,
+  reg_tx_head,
+  reg_tx_tail,
+  reg_rx_ring,
+  reg_rx_num,
+  reg_rx_head,
+  reg_rx_tail,
+  reg_intr_status,
+  reg_intr_coalesce,
+  nr_reg
+};
+
+#define NET_DESC_DONE 1
+#define NET_INTR_TX 1
+#define NET_INTR_RX 2
+
+typedef struct {
+  uint32_t addr;
+  uint16_t len;
+  uint16_t flags;
+} NetDesc;
+
+static uint32_t *net_base = NULL;
+static int sock_fd = -1;
+static struct sockaddr_un peer = {};
+static uint32_t nr_uncoalesced = 0;
+
+static NetDesc* ring_desc(int reg_ring, int reg_num, uint32_t idx) {
+  uint32_t num = net_base[reg_num];
+  paddr_t addr = net_base[reg_ring] + (idx % num) * sizeof(NetDesc);
+  Assert(in_pmem(addr), "net: ring descriptor at " FMT_PADDR " is out of pmem", addr);
+  return (NetDesc *)guest_to_host(addr);
+}
+
+static uint8_t* desc_buf(NetDesc *d) {
+  Assert(in_pmem(d->addr) && (d->len == 0 || in_pmem(d->addr + d->len - 1)),
+      "net: packet buffer at " FMT_PADDR " is out of pmem", (paddr_t)d->addr);
+  return guest_to_host(d->addr);
+}
+
+static void net_complete(int nr, uint32_t intr) {
+  if (nr == 0) return;
+  net_base[reg_intr_status] |= intr;
+  nr_uncoalesced += nr;
+  if (nr_uncoalesced >= net_base[reg_intr_coalesce]) {
+    nr_uncoalesced = 0;
+    dev_raise_intr(IRQ_NET);
+  }
+}
+
+static void net_tx() {
+  if (net_base[reg_tx_num] == 0) return;
+  while (net_base[reg_tx_tail] != net_base[reg_tx_head]) {
+    struct mmsghdr msgs[NET_BATCH];
+    struct iovec iovs[NET_BATCH];
+    NetDesc *descs[NET_BATCH];
+    int n = 0;
+    uint32_t idx = net_base[reg_tx_tail];
+    for (; n < NET_BATCH && idx != net_base[reg_tx_head]; n ++, idx ++) {
+      NetDesc *d = descs[n] = ring_desc(reg_tx_ring, reg_tx_num, idx);
+      iovs[n] = (struct iovec) { .iov_base = desc_buf(d), .iov_len = d->len };
+      msgs[n].msg_hdr = (struct msghdr) { .msg_name = &peer, .msg_namelen = sizeof(peer),
+        .msg_iov = &iovs[n], .msg_iovlen = 1 };
+    }
+    // packets which can not be delivered (e.g. no peer) are dropped
+    if (sock_fd >= 0) sendmmsg(sock_fd, msgs, n, MSG_DONTWAIT);
+    int i;
+    for (i = 0; i < n; i ++) descs[i]->flags |= NET_DESC_DONE;
+    net_base[reg_tx_tail] += n;
+    net_complete(n, NET_INTR_TX);
+  }
+}
+
+static void net_rx() {
+  if (sock_fd < 0 || net_base[reg_rx_num] == 0) return;
+  while (net_base[reg_rx_tail] != net_base[reg_rx_head]) {
+    struct mmsghdr msgs[NET_BATCH];
+    struct iovec iovs[NET_BATCH];
+    NetDesc *descs[NET_BATCH];
+    int n = 0;
+    uint32_t idx = net_base[reg_rx_tail];
+    for (; n < NET_BATCH && idx != net_base[reg_rx_head]; n ++, idx ++) {
+      NetDesc *d = descs[n] = ring_desc(reg_rx_ring, reg_rx_num, idx);
+      iovs[n] = (struct iovec) { .iov_base = desc_buf(d), .iov_len = d->len };
+      msgs[n].msg_hdr = (struct msghdr) { .msg_iov = &iovs[n], .msg_iovlen = 1 };
+    }
+    int ret = recvmmsg(sock_fd, msgs, n, MSG_DONTWAIT, NULL);
+    if (ret <= 0) return;
+    int i;
+    for (i = 0; i < ret; i ++) {
+      descs[i]->len = msgs[i].msg_len;
+      descs[i]->flags |= NET_DESC_DONE;
+    }
+    net_base[reg_rx_tail] += ret;
+    net_complete(ret, NET_INTR_RX);
+    if (ret < n) return;
+  }
+}
+
+static void net_io_handler(uint32_t offset, int len, bool is_write) {
+  switch (offset / sizeof(uint32_t)) {
+    case reg_tx_head: if (is_write) net_tx(); break;
+    case reg_rx_head: if (is_write) net_rx(); break;
+    case reg_rx_tail: if (!is_write) net_rx(); break;
+    case reg_intr_status: if (is_write) net_base[reg_intr_status] = 0; break;
+    // (re)configuring a ring resets its indices
+    case reg_tx_ring: case reg_tx_num:
+      if (is_write) net_base[reg_tx_head] = net_base[reg_tx_tail] = 0;
+      break;
+    case reg_rx_ring: case reg_rx_num:
+      if (is_write) net_base[reg_rx_head] = net_base[reg_rx_tail] = 0;
+      break;
+    default: break;
+  }
+}
+
+void net_update() {
+  net_rx();
+  if (nr_uncoalesced > 0) {
+    nr_uncoalesced = 0;
+    dev_raise_intr(IRQ_NET);
+  }
+}
+
+static bool bind_path(const char *path) {
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  return bind(sock_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+}
+
+// Check whether some one is still listening at `path`.
+static bool path_alive(const char *path) {
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+  bool alive = (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+  close(fd);
+  return alive;
+}
+
+static void init_socket() {
+  const char *path[2] = { CONFIG_NET_SOCK_PATH, CONFIG_NET_PEER_PATH };
+  sock_fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+  Assert(sock_fd >= 0, "Can not create socket for net");
+
+  // The first instance takes the first path, and the second one takes
+  // the other. Stale socket files from previous runs are removed.
+  int i;
+  for (i = 0; i < 2; i ++) {
+    if (bind_path(path[i])) break;
+    if (errno == EADDRINUSE && !path_alive(path[i])) {
+      unlink(path[i]);
+      if (bind_path(path[i])) break;
+    }
+  }
+  if (i == 2) {
+    Log("Can not bind net socket to %s or %s", path[0], path[1]);
+    close(sock_fd);
+    sock_fd = -1;
+    return;
+  }
+
+  peer = (struct sockaddr_un) { .sun_family = AF_UNIX };
+  strncpy(peer.sun_path, path[1 - i], sizeof(peer.sun_path) - 1);
+  Log("Net socket is bound to %s, peer = %s", path[i], path[1 - i]);
+}
+
+void init_net() {
+  uint32_t space_size = sizeof(uint32_t) * nr_reg;
+  net_base = (uint32_t *)new_space(space_size);
+  memset(net_base, 0, space_size);
+  add_mmio_map("net", CONFIG_NET_CTL_MMIO, net_base, space_size, net_io_handler);
+
+  init_socket();
+  net_base[reg_present] = (sock_fd >= 0);
+  net_base[reg_mtu] = NET_MTU;
+  net_base[reg_intr_coalesce] = 1;
+}
@@ -0,0 +1,78 @@
+#include <device/map.h>
+#include <device/intr.h>
+#include <cpu/cpu.h>
+
+// platform-level interrupt controller with a single context (hart 0, M-mode).
+// The registers follow the PLIC semantics, but they are packed into a
+// compact layout to save the device space.
+
+#define PLIC_PRIORITY  0x000
+#define PLIC_PENDING   0x080
+#define PLIC_ENABLE    0x100
+#define PLIC_THRESHOLD 0x200
+#define PLIC_CLAIM     0x204
+#define PLIC_SIZE      0x1000
+
+static uint32_t *plic_base = NULL;
+static uint32_t pending = 0;
+static uint32_t claimed = 0;
+
+#define reg(offset) plic_base[(offset) / sizeof(uint32_t)]
+
+static uint32_t plic_active() {
+  return pending & ~claimed & reg(PLIC_ENABLE);
+}
+
+// the pending source with the highest priority above the threshold
+static int plic_best() {
+  uint32_t active = plic_active();
+  uint32_t best_prio = reg(PLIC_THRESHOLD);
+  int best = IRQ_NONE;
+  int i;
+  for (i = 1; i < NR_IRQ; i ++) {
+    uint32_t prio = reg(PLIC_PRIORITY + i * sizeof(uint32_t));
+    if ((active & (1u << i)) && prio > best_prio) {
+      best_prio = prio;
+      best = i;
+    }
+  }
+  return best;
+}
+
+void plic_raise(int irq) {
+  pending |= (1u << irq);
+}
+
+bool plic_meip() {
+  return plic_best() != IRQ_NONE;
+}
+
+static void plic_io_handler(uint32_t offset, int len, bool is_write) {
+  switch (offset) {
+    case PLIC_PENDING:
+      if (!is_write) reg(PLIC_PENDING) = pending;
+      break;
+    case PLIC_CLAIM:
+      if (is_write) {
+        // complete
+        uint32_t irq = reg(PLIC_CLAIM);
+        if (irq < NR_IRQ) claimed &= ~(1u << irq);
+      } else {
+        int irq = plic_best();
+        if (irq != IRQ_NONE) {
+          pending &= ~(1u << irq);
+          claimed |= (1u << irq);
+        }
+        reg(PLIC_CLAIM) = irq;
+      }
+      break;
+    default: break;
+  }
+  if (is_write || offset == PLIC_CLAIM) cpu_kick_intr_check();
+}
+
+void init_plic() {
+  plic_base = (uint32_t *)new_space(PLIC_SIZE);
+  memset(plic_base, 0, PLIC_SIZE);
+  add_mmio_map("plic", CONFIG_PLIC_MMIO, plic_base, PLIC_SIZE, plic_io_handler);
+}
@@ -1,4 +1,10 @@
 #include <device/map.h>
+#include <device/intr.h>
+#include <memory/paddr.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "mmc.h"
 
 // http://www.files.e-shop.co.il/pdastore/Tech-mmc-samsung/SEC%20MMC%20SPEC%20ver09.pdf
@@ -13,8 +19,15 @@
 #define C_SIZE (NR_BLOCK / MULT - 1)
 
 // This is a simple hardware implementation of linux/drivers/mmc/host/bcm2835.c
-// No DMA and IRQ is supported, so the driver must be modified to start PIO
-// right after sending the actual read/write commands.
+// PIO raises no IRQ, so the driver must be modified to start PIO right
+// after sending the actual read/write commands.
+//
+// The image is mmap'd, and SDDATA is served directly from the mapping.
+// Besides PIO, a DMA mode is provided: if SDDMA holds a non-zero guest
+// physical address when a multiple block command is sent, the whole
+// transfer is done at once, then SDHSTS_DMA_DONE is set on success, or
+// SDHSTS_DATA_ERROR if the blocks or the buffer are out of range, and
+// IRQ_SDCARD is raised in both cases.
 
 enum {
   SDCMD, SDARG, SDTOUT, SDCDIV,
@@ -22,22 +35,46 @@ enum {
   SDHSTS, __PAD0, __PAD1, __PAD2,
   SDVDD, SDEDM, SDHCFG, SDHBCT,
   SDDATA, __PAD10, __PAD11, __PAD12,
-  SDHBLC
+  SDHBLC, SDDMA
 };
 
-static FILE *fp = NULL;
+#define SDHSTS_DATA_ERROR 0x10
+#define SDHSTS_DMA_DONE 0x8000
+#define BLK_SHIFT 9
+
+static uint8_t *img_base = NULL;
+static size_t img_size = 0;
 static uint32_t *base = NULL;
 static uint32_t blkcnt = 0;
-static long blk_addr = 0;
+static uint64_t blk_addr = 0;
 static uint32_t addr = 0;
 static bool write_cmd = 0;
 static bool read_ext_csd = false;
 
+static bool img_range_ok(uint64_t offset, uint64_t len) {
+  return img_base != NULL && offset <= img_size && len <= img_size - offset;
+}
+
+static void do_dma() {
+  uint64_t offset = blk_addr << BLK_SHIFT;
+  uint64_t len = (uint64_t)blkcnt << BLK_SHIFT;
+  paddr_t dma_addr = base[SDDMA];
+  if (img_range_ok(offset, len) && in_pmem(dma_addr) && in_pmem(dma_addr + len - 1)) {
+    uint8_t *mem = guest_to_host(dma_addr);
+    if (write_cmd) memcpy(img_base + offset, mem, len);
+    else memcpy(mem, img_base + offset, len);
+    base[SDHSTS] |= SDHSTS_DMA_DONE;
+  } else {
+    base[SDHSTS] |= SDHSTS_DATA_ERROR;
+  }
+  dev_raise_intr(IRQ_SDCARD);
+}
+
 static void prepare_rw(int is_write) {
   blk_addr = base[SDARG];
   addr = 0;
-  if (fp) fseek(fp, blk_addr << 9, SEEK_SET);
   write_cmd = is_write;
+  if (base[SDDMA] != 0 && blkcnt != 0) do_dma();
 }
 
 static void sdcard_handle_cmd(int cmd) {
@@ -94,13 +131,24 @@ static void sdcard_io_handler(uint32_t offset, int len, bool is_write) {
          }
          base[SDDATA] = data;
          if (addr == 512 - 4) read_ext_csd = false;
-       } else if (fp) {
-         __attribute__((unused)) int ret;
-         if (!write_cmd) { ret = fread(&base[SDDATA], 4, 1, fp); }
-         else { ret = fwrite(&base[SDDATA], 4, 1, fp); }
+       } else {
+         uint64_t offset = (blk_addr << BLK_SHIFT) + addr;
+         if (img_range_ok(offset, 4)) {
+           if (!write_cmd) { memcpy(&base[SDDATA], img_base + offset, 4); }
+           else { memcpy(img_base + offset, &base[SDDATA], 4); }
+         }
        }
        addr += 4;
        break;
+    case SDHSTS:
+      // any write clears the status
+      if (is_write) base[SDHSTS] = 0;
+      break;
+    case SDHBLC:
+      if (is_write) blkcnt = base[SDHBLC] & 0xffff;
+      break;
+    case SDDMA:
+      break;
     default:
       Log("offset = 0x%x(idx = %d), is_write = %d, data = 0x%x", offset, idx, is_write, base[idx]);
       panic("unhandle offset = %d", offset);
@@ -114,6 +162,16 @@ void init_sdcard() {
   Assert(C_SIZE < (1 << 12), "shoule be fit in 12 bits");
 
   const char *img = CONFIG_SDCARD_IMG_PATH;
-  fp = fopen(img, "r+");
-  if (fp == NULL) Log("Can not find sdcard image: %s", img);
+  int fd = open(img, O_RDWR);
+  if (fd < 0) { Log("Can not find sdcard image: %s", img); return; }
+
+  struct stat st;
+  int ret = fstat(fd, &st);
+  Assert(ret == 0, "Can not stat sdcard image: %s", img);
+  img_size = st.st_size;
+  if (img_size > 0) {
+    img_base = mmap(NULL, img_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    Assert(img_base != MAP_FAILED, "Can not mmap sdcard image: %s", img);
+  }
+  close(fd);
 }
@@ -5,21 +5,92 @@
 // NOTE: this is compatible to 16550
 
 #define CH_OFFSET 0
+#define LSR_OFFSET 5
+
+#define LSR_DR   0x01 // data ready
+#define LSR_THRE 0x20 // transmitter holding register empty
+#define LSR_TEMT 0x40 // transmitter empty
 
 static uint8_t *serial_base = NULL;
 
+#ifndef CONFIG_TARGET_AM
+// stderr is unbuffered, so we buffer the output by ourselves. The buffer
+// is flushed on newline, when it is full, at every device update and at exit.
+#define OUTBUF_SIZE 4096
+static char outbuf[OUTBUF_SIZE];
+static int outbuf_len = 0;
+
+static void serial_flush() {
+  if (outbuf_len > 0) {
+    fwrite(outbuf, 1, outbuf_len, stderr);
+    outbuf_len = 0;
+  }
+}
+#endif
+
+void serial_update() {
+  IFNDEF(CONFIG_TARGET_AM, serial_flush());
+}
 
 static void serial_putc(char ch) {
-  MUXDEF(CONFIG_TARGET_AM, putch(ch), putc(ch, stderr));
+#ifdef CONFIG_TARGET_AM
+  putch(ch);
+#else
+  outbuf[outbuf_len ++] = ch;
+  if (ch == '\n' || outbuf_len == OUTBUF_SIZE) serial_flush();
+#endif
 }
 
+#ifdef CONFIG_SERIAL_INPUT_FIFO
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define FIFO_PATH "/tmp/nemu.serial"
+#define INBUF_SIZE 256
+
+static int fifo_fd = -1;
+static char inbuf[INBUF_SIZE];
+static int inbuf_f = 0, inbuf_r = 0;
+
+static bool serial_has_input() {
+  if (inbuf_f == inbuf_r && fifo_fd >= 0) {
+    // never blocks, since the fifo is opened with O_NONBLOCK
+    ssize_t ret = read(fifo_fd, inbuf, INBUF_SIZE);
+    inbuf_f = 0;
+    inbuf_r = (ret > 0 ? ret : 0);
+  }
+  return inbuf_f != inbuf_r;
+}
+
+static char serial_getc() {
+  return (serial_has_input() ? inbuf[inbuf_f ++] : 0xff);
+}
+
+static void init_fifo() {
+  int ret = mkfifo(FIFO_PATH, 0666);
+  Assert(ret == 0 || errno == EEXIST, "Can not create fifo %s", FIFO_PATH);
+  // open with O_RDWR to avoid getting EOF when there is no writer
+  fifo_fd = open(FIFO_PATH, O_RDWR | O_NONBLOCK);
+  Assert(fifo_fd >= 0, "Can not open fifo %s", FIFO_PATH);
+  Log("Serial input is read from %s", FIFO_PATH);
+}
+#endif
+
 static void serial_io_handler(uint32_t offset, int len, bool is_write) {
   assert(len == 1);
   switch (offset) {
     /* We bind the serial port with the host stderr in NEMU. */
     case CH_OFFSET:
       if (is_write) serial_putc(serial_base[0]);
-      else panic("do not support read");
+      else serial_base[0] = MUXDEF(CONFIG_SERIAL_INPUT_FIFO, serial_getc(), 0xff);
+      break;
+    case LSR_OFFSET:
+      if (!is_write) {
+        serial_base[LSR_OFFSET] = LSR_THRE | LSR_TEMT |
+          MUXDEF(CONFIG_SERIAL_INPUT_FIFO, (serial_has_input() ? LSR_DR : 0), 0);
+      }
       break;
     default: panic("do not support offset = %d", offset);
   }
@@ -33,4 +104,6 @@ void init_serial() {
   add_mmio_map("serial", CONFIG_SERIAL_MMIO, serial_base, 8, serial_io_handler);
 #endif
 
+  IFNDEF(CONFIG_TARGET_AM, atexit(serial_flush));
+  IFDEF(CONFIG_SERIAL_INPUT_FIFO, init_fifo());
 }
@@ -1,5 +1,4 @@
 #include <device/map.h>
-#include <device/alarm.h>
 #include <utils.h>
 
 static uint32_t *rtc_port_base = NULL;
@@ -13,15 +12,6 @@ static void rtc_io_handler(uint32_t offset, int len, bool is_write) {
   }
 }
 
-#ifndef CONFIG_TARGET_AM
-static void timer_intr() {
-  if (nemu_state.state == NEMU_RUNNING) {
-    extern void dev_raise_intr();
-    dev_raise_intr();
-  }
-}
-#endif
-
 void init_timer() {
   rtc_port_base = (uint32_t *)new_space(8);
 #ifdef CONFIG_HAS_PORT_IO
@@ -29,5 +19,4 @@ void init_timer() {
 #else
   add_mmio_map("rtc", CONFIG_RTC_MMIO, rtc_port_base, 8, rtc_io_handler);
 #endif
-  IFNDEF(CONFIG_TARGET_AM, add_alarm_handle(timer_intr));
 }
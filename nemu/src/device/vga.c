@@ -1,5 +1,6 @@
 #include <common.h>
 #include <device/map.h>
+#include <memory/paddr.h>
 
 #define SCREEN_W (MUXDEF(CONFIG_VGA_SIZE_800x600, 800, 400))
 #define SCREEN_H (MUXDEF(CONFIG_VGA_SIZE_800x600, 600, 300))
@@ -18,6 +19,15 @@ static uint32_t screen_size() {
 
 static void *vmem = NULL;
 static uint32_t *vgactl_port_base = NULL;
+// dirty rows of vmem since the last update of the screen
+static int dirty_y0 = 0, dirty_y1 = -1;
+
+static void vmem_mark_dirty(uint32_t offset, int len, bool is_write) {
+  int pitch = screen_width() * sizeof(uint32_t);
+  int y0 = offset / pitch, y1 = (offset + len - 1) / pitch;
+  if (y0 < dirty_y0) dirty_y0 = y0;
+  if (y1 > dirty_y1) dirty_y1 = y1;
+}
 
 #ifdef CONFIG_VGA_SHOW_SCREEN
 #ifndef CONFIG_TARGET_AM
@@ -41,7 +51,8 @@ static void init_screen() {
 }
 
 static inline void update_screen() {
-  SDL_UpdateTexture(texture, NULL, vmem, SCREEN_W * sizeof(uint32_t));
+  SDL_Rect rect = { .x = 0, .y = dirty_y0, .w = SCREEN_W, .h = dirty_y1 - dirty_y0 + 1 };
+  SDL_UpdateTexture(texture, &rect, (uint32_t *)vmem + dirty_y0 * SCREEN_W, SCREEN_W * sizeof(uint32_t));
   SDL_RenderClear(renderer);
   SDL_RenderCopy(renderer, texture, NULL, NULL);
   SDL_RenderPresent(renderer);
@@ -55,9 +66,196 @@ static inline void update_screen() {
 #endif
 #endif
 
+#ifdef CONFIG_VGA_ACCEL
+// 2D accelerator for AM_GPU_MEMCPY and AM_GPU_RENDER. Textures and canvas
+// trees are uploaded into the device memory, and the tree is composited
+// by NEMU straight into `vmem`. The layout of the canvas nodes is the
+// same as `struct gpu_canvas` in amdev.h.
+
+#define GPU_MEM_SIZE (512 * 1024)
+#define GPU_SCRATCH_SIZE (4 * 1024 * 1024)
+#define GPU_MAX_DEPTH 16
+#define GPU_MAX_NODES 4096
+
+#define GPU_TEXTURE 1
+#define GPU_SUBTREE 2
+#define GPU_NULL    0xffffffff
+
+enum { GPU_CMD_NONE, GPU_CMD_MEMCPY, GPU_CMD_RENDER };
+enum { reg_cmd, reg_src, reg_dest, reg_size, reg_root, reg_memsz, nr_gpu_reg };
+
+typedef uint32_t gpuptr_t;
+
+typedef struct {
+  uint16_t type, w, h, x1, y1, w1, h1;
+  gpuptr_t sibling;
+  union {
+    gpuptr_t child;
+    struct {
+      uint16_t w, h;
+      gpuptr_t pixels;
+    } __attribute__((packed)) texture;
+  };
+} __attribute__((packed)) GPUCanvas;
+
+static uint8_t *gpu_mem = NULL;
+static uint32_t *gpuctl_base = NULL;
+static uint32_t *scratch = NULL;
+static size_t scratch_used = 0;
+
+static bool gpu_range_ok(gpuptr_t p, size_t size) {
+  return p <= GPU_MEM_SIZE && size <= GPU_MEM_SIZE - p;
+}
+
+// the range should be checked before
+static void *gpu_ptr(gpuptr_t p) {
+  return (p == GPU_NULL ? NULL : gpu_mem + p);
+}
+
+static uint32_t *scratch_alloc(int w, int h) {
+  size_t n = (size_t)w * h;
+  assert(scratch_used + n <= GPU_SCRATCH_SIZE / sizeof(uint32_t)); // checked by check_canvas()
+  uint32_t *p = scratch + scratch_used;
+  scratch_used += n;
+  memset(p, 0, n * sizeof(uint32_t));
+  return p;
+}
+
+// draw the local canvas `src` (w * h) into `dst` (W * H)
+// at (x1, y1) - (x1 + w1, y1 + h1), clipped by the destination
+static void blit(uint32_t *dst, int W, int H, GPUCanvas *cv, uint32_t *src, int w, int h) {
+  int x1 = cv->x1, y1 = cv->y1, w1 = cv->w1, h1 = cv->h1;
+  if (x1 >= W || y1 >= H || w == 0 || h == 0) return;
+  int cw = (x1 + w1 > W ? W - x1 : w1);
+  int ch = (y1 + h1 > H ? H - y1 : h1);
+  int i, j;
+  if (w1 == w && h1 == h) {
+    // no scaling, copy the whole rows
+    for (j = 0; j < ch; j ++) {
+      memcpy(dst + (y1 + j) * W + x1, src + j * w, cw * sizeof(uint32_t));
+    }
+    return;
+  }
+  for (j = 0; j < ch; j ++) {
+    uint32_t *d = dst + (y1 + j) * W + x1;
+    uint32_t *s = src + w * (j * h / h1);
+    for (i = 0; i < cw; i ++) {
+      d[i] = s[i * w / w1];
+    }
+  }
+}
+
+static int nr_node = 0;
+static size_t scratch_need = 0;
+
+// The tree comes from the guest, so it is checked as a whole before
+// anything is drawn. Return the problem found, or NULL. Siblings linked
+// into a cycle are caught by the limit on the number of nodes.
+static const char *check_canvas(gpuptr_t p, int depth) {
+  if (++ nr_node > GPU_MAX_NODES) return "too many canvas nodes";
+  if (depth >= GPU_MAX_DEPTH) return "canvas tree is too deep";
+  if (!gpu_range_ok(p, sizeof(GPUCanvas))) return "canvas node is out of the device memory";
+  GPUCanvas *cv = gpu_ptr(p);
+  switch (cv->type) {
+    case GPU_TEXTURE:
+      if (cv->texture.pixels != GPU_NULL && !gpu_range_ok(cv->texture.pixels,
+            (size_t)cv->texture.w * cv->texture.h * sizeof(uint32_t))) {
+        return "texture is out of the device memory";
+      }
+      return NULL;
+    case GPU_SUBTREE: {
+      scratch_need += (size_t)cv->w * cv->h;
+      if (scratch_need > GPU_SCRATCH_SIZE / sizeof(uint32_t)) return "out of scratch memory";
+      gpuptr_t ch;
+      for (ch = cv->child; ch != GPU_NULL; ch = ((GPUCanvas *)gpu_ptr(ch))->sibling) {
+        const char *err = check_canvas(ch, depth + 1);
+        if (err) return err;
+      }
+      return NULL;
+    }
+    default: return "invalid canvas type";
+  }
+}
+
+static void render(GPUCanvas *cv, uint32_t *dst, int W, int H) {
+  uint32_t *local;
+  int w, h;
+  switch (cv->type) {
+    case GPU_TEXTURE:
+      w = cv->texture.w; h = cv->texture.h;
+      local = gpu_ptr(cv->texture.pixels);
+      if (local == NULL) return; // a texture without pixels draws nothing
+      break;
+    case GPU_SUBTREE: {
+      w = cv->w; h = cv->h;
+      local = scratch_alloc(w, h);
+      GPUCanvas *ch;
+      for (ch = gpu_ptr(cv->child); ch != NULL; ch = gpu_ptr(ch->sibling)) {
+        render(ch, local, w, h);
+      }
+      break;
+    }
+    default: return;
+  }
+  blit(dst, W, H, cv, local, w, h);
+}
+
+static void gpuctl_io_handler(uint32_t offset, int len, bool is_write) {
+  if (!is_write || offset != reg_cmd * sizeof(uint32_t)) return;
+  switch (gpuctl_base[reg_cmd]) {
+    case GPU_CMD_MEMCPY: {
+      paddr_t src = gpuctl_base[reg_src];
+      uint32_t size = gpuctl_base[reg_size];
+      gpuptr_t dest = gpuctl_base[reg_dest];
+      if (size == 0 || dest == GPU_NULL) break;
+      if (size > CONFIG_MSIZE || !in_pmem(src) || !in_pmem(src + size - 1) ||
+          !gpu_range_ok(dest, size)) {
+        Log("gpu: memcpy out of range is skipped");
+        break;
+      }
+      memcpy(gpu_ptr(dest), guest_to_host(src), size);
+      break;
+    }
+    case GPU_CMD_RENDER: {
+      gpuptr_t root = gpuctl_base[reg_root];
+      if (root == GPU_NULL) break;
+      nr_node = 0;
+      scratch_need = 0;
+      const char *err = check_canvas(root, 0);
+      if (err) {
+        Log("gpu: render is skipped, %s", err);
+        break;
+      }
+      scratch_used = 0;
+      render(gpu_ptr(root), vmem, screen_width(), screen_height());
+      vmem_mark_dirty(0, screen_size(), true);
+      break;
+    }
+    default: break;
+  }
+  gpuctl_base[reg_cmd] = GPU_CMD_NONE;
+}
+
+static void init_gpu_accel() {
+  gpuctl_base = (uint32_t *)new_space(sizeof(uint32_t) * nr_gpu_reg);
+  gpuctl_base[reg_memsz] = GPU_MEM_SIZE;
+  add_mmio_map("gpuctl", CONFIG_GPU_CTL_MMIO, gpuctl_base, sizeof(uint32_t) * nr_gpu_reg, gpuctl_io_handler);
+
+  gpu_mem = new_space(GPU_MEM_SIZE);
+  add_mmio_mem("gpu-mem", CONFIG_GPU_MEM_ADDR, gpu_mem, GPU_MEM_SIZE);
+
+  scratch = malloc(GPU_SCRATCH_SIZE);
+  assert(scratch);
+}
+#endif
+
 void vga_update_screen() {
-  // TODO: call `update_screen()` when the sync register is non-zero,
-  // then zero out the sync register
+  if (vgactl_port_base[1] == 0) return;
+  vgactl_port_base[1] = 0;
+  if (dirty_y1 < dirty_y0) return;
+  IFDEF(CONFIG_VGA_SHOW_SCREEN, update_screen());
+  dirty_y0 = screen_height();
+  dirty_y1 = -1;
 }
 
 void init_vga() {
@@ -70,7 +268,10 @@ void init_vga() {
 #endif
 
   vmem = new_space(screen_size());
-  add_mmio_map("vmem", CONFIG_FB_ADDR, vmem, screen_size(), NULL);
+  // stores to vmem are coalesced and flushed once per device update
+  add_mmio_wc_map("vmem", CONFIG_FB_ADDR, vmem, screen_size(), vmem_mark_dirty);
   IFDEF(CONFIG_VGA_SHOW_SCREEN, init_screen());
   IFDEF(CONFIG_VGA_SHOW_SCREEN, memset(vmem, 0, screen_size()));
+  vmem_mark_dirty(0, screen_size(), true);
+  IFDEF(CONFIG_VGA_ACCEL, init_gpu_accel());
 }
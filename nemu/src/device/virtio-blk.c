@@ -0,0 +1,118 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <device/intr.h>
+#include "virtio.h"
+
+// virtio-blk with a host image. Data is transferred with pread/pwrite
+// straight from/to the guest buffers described by the virtqueue.
+
+#define SECTOR_SIZE 512
+
+#define VIRTIO_BLK_T_IN     0
+#define VIRTIO_BLK_T_OUT    1
+#define VIRTIO_BLK_T_GET_ID 8
+
+#define VIRTIO_BLK_S_OK     0
+#define VIRTIO_BLK_S_IOERR  1
+#define VIRTIO_BLK_S_UNSUPP 2
+
+#define VIRTIO_BLK_ID_BYTES 20
+
+typedef struct {
+  uint32_t type;
+  uint32_t reserved;
+  uint64_t sector;
+} __attribute__((packed)) VirtioBlkReqHdr;
+
+static struct {
+  uint64_t capacity; // in sectors
+} blk_config;
+
+static int img_fd = -1;
+static VirtioDev blk_dev;
+
+static bool blk_rw(bool is_write, uint8_t *buf, off_t offset, size_t len) {
+  while (len > 0) {
+    ssize_t ret = (is_write ? pwrite(img_fd, buf, len, offset) : pread(img_fd, buf, len, offset));
+    if (ret <= 0) return false;
+    buf += ret;
+    offset += ret;
+    len -= ret;
+  }
+  return true;
+}
+
+// the data buffers are device-writable for reads and device-readable for
+// writes, and the request must not go beyond the end of the image
+static bool blk_req_ok(VirtioBlkReqHdr *hdr, VirtioBuf *bufs, int nr_buf) {
+  bool is_write = (hdr->type == VIRTIO_BLK_T_OUT);
+  uint64_t len = 0;
+  int i;
+  for (i = 1; i < nr_buf - 1; i ++) {
+    if (bufs[i].is_write == is_write) return false;
+    len += bufs[i].len;
+  }
+  return img_fd >= 0 && hdr->sector <= blk_config.capacity &&
+    len <= (blk_config.capacity - hdr->sector) * SECTOR_SIZE;
+}
+
+static uint32_t blk_handler(VirtioDev *dev, int qid, VirtioBuf *bufs, int nr_buf) {
+  // without a device-writable status byte, nothing can be reported
+  if (nr_buf < 1 || !bufs[nr_buf - 1].is_write || bufs[nr_buf - 1].len < 1) return 0;
+  uint8_t *status = bufs[nr_buf - 1].buf;
+  if (nr_buf < 2 || bufs[0].is_write || bufs[0].len < sizeof(VirtioBlkReqHdr)) {
+    *status = VIRTIO_BLK_S_IOERR;
+    return 1;
+  }
+
+  VirtioBlkReqHdr *hdr = (VirtioBlkReqHdr *)bufs[0].buf;
+  off_t offset = hdr->sector * SECTOR_SIZE;
+  uint32_t written = 1; // the status byte
+  uint8_t s = VIRTIO_BLK_S_OK;
+  int i;
+
+  switch (hdr->type) {
+    case VIRTIO_BLK_T_IN:
+    case VIRTIO_BLK_T_OUT:
+      if (!blk_req_ok(hdr, bufs, nr_buf)) { s = VIRTIO_BLK_S_IOERR; break; }
+      for (i = 1; i < nr_buf - 1 && s == VIRTIO_BLK_S_OK; i ++) {
+        bool is_write = (hdr->type == VIRTIO_BLK_T_OUT);
+        if (!blk_rw(is_write, bufs[i].buf, offset, bufs[i].len)) s = VIRTIO_BLK_S_IOERR;
+        if (!is_write) written += bufs[i].len;
+        offset += bufs[i].len;
+      }
+      break;
+    case VIRTIO_BLK_T_GET_ID:
+      if (nr_buf > 2 && bufs[1].is_write) {
+        uint32_t len = (bufs[1].len < VIRTIO_BLK_ID_BYTES ? bufs[1].len : VIRTIO_BLK_ID_BYTES);
+        memset(bufs[1].buf, 0, len);
+        strncpy((char *)bufs[1].buf, "nemu-virtio-blk", len);
+        written += len;
+      }
+      else s = VIRTIO_BLK_S_IOERR;
+      break;
+    default: s = VIRTIO_BLK_S_UNSUPP; break;
+  }
+
+  *status = s;
+  return written;
+}
+
+static void virtio_blk_io_handler(uint32_t offset, int len, bool is_write) {
+  virtio_mmio_access(&blk_dev, offset, len, is_write);
+}
+
+void init_virtio_blk() {
+  const char *img = CONFIG_VIRTIO_BLK_IMG_PATH;
+  img_fd = open(img, O_RDWR);
+  if (img_fd < 0) Log("Can not find virtio-blk image: %s", img);
+  else blk_config.capacity = lseek(img_fd, 0, SEEK_END) / SECTOR_SIZE;
+
+  blk_dev = (VirtioDev) {
+    .name = "virtio-blk", .device_id = VIRTIO_ID_BLOCK, .irq = IRQ_VIRTIO_BLK,
+    .features = VIRTIO_F_VERSION_1,
+    .nr_queue = 1, .config = &blk_config, .config_size = sizeof(blk_config),
+    .handler = blk_handler,
+  };
+  virtio_mmio_init(&blk_dev, CONFIG_VIRTIO_BLK_MMIO, virtio_blk_io_handler);
+}
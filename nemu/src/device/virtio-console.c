@@ -0,0 +1,38 @@
+#include <device/intr.h>
+#include "virtio.h"
+
+// virtio-console with a single port. Everything the guest puts into
+// the transmit queue is written to the host stderr, one chain per call.
+// No host input is fed into the receive queue.
+
+enum { RECEIVEQ, TRANSMITQ, NR_QUEUE };
+
+static struct {
+  uint16_t cols, rows;
+  uint32_t max_nr_ports;
+  uint32_t emerg_wr;
+} console_config = { .cols = 80, .rows = 25, .max_nr_ports = 1 };
+
+static VirtioDev console_dev;
+
+static uint32_t console_handler(VirtioDev *dev, int qid, VirtioBuf *bufs, int nr_buf) {
+  int i;
+  for (i = 0; i < nr_buf; i ++) {
+    if (!bufs[i].is_write) fwrite(bufs[i].buf, 1, bufs[i].len, stderr);
+  }
+  return 0;
+}
+
+static void virtio_console_io_handler(uint32_t offset, int len, bool is_write) {
+  virtio_mmio_access(&console_dev, offset, len, is_write);
+}
+
+void init_virtio_console() {
+  console_dev = (VirtioDev) {
+    .name = "virtio-console", .device_id = VIRTIO_ID_CONSOLE, .irq = IRQ_VIRTIO_CONSOLE,
+    .features = VIRTIO_F_VERSION_1,
+    .nr_queue = NR_QUEUE, .rx_queue_mask = 1u << RECEIVEQ, .config = &console_config, .config_size = sizeof(console_config),
+    .handler = console_handler,
+  };
+  virtio_mmio_init(&console_dev, CONFIG_VIRTIO_CONSOLE_MMIO, virtio_console_io_handler);
+}
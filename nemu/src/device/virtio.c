@@ -0,0 +1,235 @@
+#include <memory/paddr.h>
+#include <device/intr.h>
+#include "virtio.h"
+
+enum {
+  MagicValue        = 0x000,
+  Version           = 0x004,
+  DeviceID          = 0x008,
+  VendorID          = 0x00c,
+  DeviceFeatures    = 0x010,
+  DeviceFeaturesSel = 0x014,
+  DriverFeatures    = 0x020,
+  DriverFeaturesSel = 0x024,
+  QueueSel          = 0x030,
+  QueueNumMax       = 0x034,
+  QueueNum          = 0x038,
+  QueueReady        = 0x044,
+  QueueNotify       = 0x050,
+  InterruptStatus   = 0x060,
+  InterruptACK      = 0x064,
+  Status            = 0x070,
+  QueueDescLow      = 0x080,
+  QueueDescHigh     = 0x084,
+  QueueDriverLow    = 0x090,
+  QueueDriverHigh   = 0x094,
+  QueueDeviceLow    = 0x0a0,
+  QueueDeviceHigh   = 0x0a4,
+  ConfigGeneration  = 0x0fc,
+};
+
+#define VIRTIO_MAGIC  0x74726976 // "virt"
+#define VIRTIO_VENDOR 0x554d454e // "NEMU"
+
+#define VRING_DESC_F_NEXT  1
+#define VRING_DESC_F_WRITE 2
+
+#define VIRTIO_INTR_USED_RING 1
+#define VIRTIO_INTR_CONFIG    2
+
+#define VIRTIO_STATUS_NEEDS_RESET 0x40
+
+typedef struct {
+  uint64_t addr;
+  uint32_t len;
+  uint16_t flags;
+  uint16_t next;
+} __attribute__((packed)) VringDesc;
+
+typedef struct {
+  uint16_t flags;
+  uint16_t idx;
+  uint16_t ring[];
+} __attribute__((packed)) VringAvail;
+
+typedef struct {
+  uint32_t id;
+  uint32_t len;
+} __attribute__((packed)) VringUsedElem;
+
+typedef struct {
+  uint16_t flags;
+  uint16_t idx;
+  VringUsedElem ring[];
+} __attribute__((packed)) VringUsed;
+
+// return NULL if the buffer is not in pmem
+static void *vring_ptr(paddr_t addr, size_t size) {
+  if (!in_pmem(addr) || size > CONFIG_MSIZE || (size != 0 && !in_pmem(addr + size - 1))) return NULL;
+  return guest_to_host(addr);
+}
+
+// The driver has done something wrong. The device stops working until it
+// is reset by the driver, as required by the spec.
+static void virtio_fail(VirtioDev *dev, const char *why) {
+  Log("virtio %s: %s, the device needs reset", dev->name, why);
+  dev->status |= VIRTIO_STATUS_NEEDS_RESET;
+  dev->intr_status |= VIRTIO_INTR_CONFIG;
+  dev_raise_intr(dev->irq);
+}
+
+// the selected queue, or NULL if the device does not have it
+static VirtioQueue *sel_queue(VirtioDev *dev) {
+  return (dev->queue_sel < dev->nr_queue ? &dev->queue[dev->queue_sel] : NULL);
+}
+
+static void set_addr_lo(paddr_t *p, uint32_t val) {
+  *p = MUXDEF(PMEM64, (*p & ~0xffffffffull) | val, val);
+}
+
+static void set_addr_hi(paddr_t *p, uint32_t val) {
+  IFDEF(PMEM64, *p = (*p & 0xffffffffull) | ((uint64_t)val << 32));
+}
+
+bool virtio_queue_process(VirtioDev *dev, int qid) {
+  VirtioQueue *q = &dev->queue[qid];
+  if (!q->ready || q->num == 0 || (dev->status & VIRTIO_STATUS_NEEDS_RESET)) return false;
+
+  VringDesc *desc = vring_ptr(q->desc, sizeof(VringDesc) * q->num);
+  VringAvail *avail = vring_ptr(q->avail, sizeof(VringAvail) + sizeof(uint16_t) * q->num);
+  VringUsed *used = vring_ptr(q->used, sizeof(VringUsed) + sizeof(VringUsedElem) * q->num);
+  if (desc == NULL || avail == NULL || used == NULL) {
+    virtio_fail(dev, "the virtqueue is out of pmem");
+    return false;
+  }
+
+  uint16_t avail_idx = __atomic_load_n(&avail->idx, __ATOMIC_ACQUIRE);
+  uint16_t used_idx = used->idx;
+  bool progress = false;
+
+  while (q->last_avail_idx != avail_idx) {
+    uint16_t head = avail->ring[q->last_avail_idx % q->num];
+    VirtioBuf bufs[VIRTIO_QUEUE_NUM_MAX];
+    int nr_buf = 0;
+    uint16_t i = head;
+    const char *bad = NULL;
+    while (true) {
+      if (i >= q->num || nr_buf == q->num) { bad = "bad descriptor chain"; break; }
+      VringDesc *d = &desc[i];
+      bufs[nr_buf] = (VirtioBuf) { .buf = vring_ptr(d->addr, d->len), .len = d->len,
+        .is_write = (d->flags & VRING_DESC_F_WRITE) != 0 };
+      if (bufs[nr_buf ++].buf == NULL) { bad = "buffer out of pmem"; break; }
+      if (!(d->flags & VRING_DESC_F_NEXT)) break;
+      i = d->next;
+    }
+    if (bad) {
+      virtio_fail(dev, bad);
+      break;
+    }
+
+    uint32_t written = dev->handler(dev, qid, bufs, nr_buf);
+    used->ring[used_idx % q->num] = (VringUsedElem) { .id = head, .len = written };
+    used_idx ++;
+    q->last_avail_idx ++;
+    progress = true;
+  }
+
+  if (progress) {
+    // publish all the used elements at once
+    __atomic_store_n(&used->idx, used_idx, __ATOMIC_RELEASE);
+    dev->intr_status |= VIRTIO_INTR_USED_RING;
+    dev_raise_intr(dev->irq);
+  }
+  return progress;
+}
+
+static void virtio_reset(VirtioDev *dev) {
+  dev->driver_features = 0;
+  dev->queue_sel = 0;
+  dev->status = 0;
+  dev->intr_status = 0;
+  memset(dev->queue, 0, sizeof(dev->queue));
+}
+
+static uint32_t virtio_reg_read(VirtioDev *dev, uint32_t offset) {
+  VirtioQueue *q = sel_queue(dev);
+  switch (offset) {
+    case MagicValue: return VIRTIO_MAGIC;
+    case Version: return 2;
+    case DeviceID: return dev->device_id;
+    case VendorID: return VIRTIO_VENDOR;
+    case DeviceFeatures:
+      return (dev->base[DeviceFeaturesSel / 4] == 0 ? dev->features : dev->features >> 32);
+    case QueueNumMax: return (q ? VIRTIO_QUEUE_NUM_MAX : 0);
+    case QueueNum: return (q ? q->num : 0);
+    case QueueReady: return (q ? q->ready : 0);
+    case InterruptStatus: return dev->intr_status;
+    case Status: return dev->status;
+    case ConfigGeneration: return 0;
+    default: return dev->base[offset / 4];
+  }
+}
+
+static void virtio_reg_write(VirtioDev *dev, uint32_t offset, uint32_t val) {
+  VirtioQueue *q = sel_queue(dev);
+  switch (offset) {
+    case QueueNum: case QueueReady:
+    case QueueDescLow: case QueueDescHigh:
+    case QueueDriverLow: case QueueDriverHigh:
+    case QueueDeviceLow: case QueueDeviceHigh:
+      if (q == NULL) { virtio_fail(dev, "no such queue"); return; }
+      break;
+  }
+  switch (offset) {
+    case DeviceFeaturesSel: break;
+    case DriverFeatures:
+      if (dev->base[DriverFeaturesSel / 4] == 0)
+        dev->driver_features = (dev->driver_features & ~0xffffffffull) | val;
+      else dev->driver_features = (dev->driver_features & 0xffffffffull) | ((uint64_t)val << 32);
+      break;
+    case DriverFeaturesSel: break;
+    // QueueNumMax of a queue which does not exist reads 0
+    case QueueSel: dev->queue_sel = val; break;
+    case QueueNum:
+      if (val > VIRTIO_QUEUE_NUM_MAX) virtio_fail(dev, "queue size too large");
+      else q->num = val;
+      break;
+    case QueueReady: q->ready = (val & 1); break;
+    case QueueNotify:
+      if (val < dev->nr_queue && !(dev->rx_queue_mask & (1u << val))) virtio_queue_process(dev, val);
+      break;
+    case InterruptACK: dev->intr_status &= ~val; break;
+    case Status:
+      if (val == 0) virtio_reset(dev);
+      else dev->status = val;
+      break;
+    case QueueDescLow:    set_addr_lo(&q->desc, val); break;
+    case QueueDescHigh:   set_addr_hi(&q->desc, val); break;
+    case QueueDriverLow:  set_addr_lo(&q->avail, val); break;
+    case QueueDriverHigh: set_addr_hi(&q->avail, val); break;
+    case QueueDeviceLow:  set_addr_lo(&q->used, val); break;
+    case QueueDeviceHigh: set_addr_hi(&q->used, val); break;
+    default: break; // read-only registers
+  }
+}
+
+void virtio_mmio_access(VirtioDev *dev, uint32_t offset, int len, bool is_write) {
+  // the device-specific configuration space is plain memory
+  if (offset >= VIRTIO_MMIO_CONFIG) return;
+  if (len != 4 || (offset & 3) != 0) {
+    virtio_fail(dev, "registers must be accessed with aligned 32-bit words");
+    return;
+  }
+  if (is_write) virtio_reg_write(dev, offset, dev->base[offset / 4]);
+  else dev->base[offset / 4] = virtio_reg_read(dev, offset);
+}
+
+void virtio_mmio_init(VirtioDev *dev, paddr_t addr, io_callback_t callback) {
+  assert(dev->nr_queue <= VIRTIO_MAX_QUEUE);
+  assert(dev->config_size <= VIRTIO_MMIO_SPACE_SIZE - VIRTIO_MMIO_CONFIG);
+  dev->base = (uint32_t *)new_space(VIRTIO_MMIO_SPACE_SIZE);
+  memset(dev->base, 0, VIRTIO_MMIO_SPACE_SIZE);
+  memcpy((uint8_t *)dev->base + VIRTIO_MMIO_CONFIG, dev->config, dev->config_size);
+  virtio_reset(dev);
+  add_mmio_map(dev->name, addr, dev->base, VIRTIO_MMIO_SPACE_SIZE, callback);
+}
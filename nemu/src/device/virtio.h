@@ -0,0 +1,61 @@
+#ifndef __VIRTIO_H__
+#define __VIRTIO_H__
+
+#include <device/map.h>
+
+// https://docs.oasis-open.org/virtio/virtio/v1.1/virtio-v1.1.html
+// Only the virtio-mmio transport (version 2) with split virtqueues is
+// implemented. Descriptors are accessed in place via guest_to_host().
+
+#define VIRTIO_MMIO_SPACE_SIZE 0x200
+#define VIRTIO_MMIO_CONFIG     0x100
+#define VIRTIO_MAX_QUEUE       2
+#define VIRTIO_QUEUE_NUM_MAX   256
+
+#define VIRTIO_ID_BLOCK   2
+#define VIRTIO_ID_CONSOLE 3
+
+#define VIRTIO_F_VERSION_1 (1ull << 32)
+
+typedef struct {
+  uint8_t *buf;
+  uint32_t len;
+  bool is_write; // written by the device
+} VirtioBuf;
+
+typedef struct {
+  uint32_t num;
+  bool ready;
+  paddr_t desc, avail, used;
+  uint16_t last_avail_idx;
+} VirtioQueue;
+
+struct VirtioDev;
+// handle one descriptor chain, and return the number of bytes written into it
+typedef uint32_t (*virtio_handler_t)(struct VirtioDev *dev, int qid, VirtioBuf *bufs, int nr_buf);
+
+typedef struct VirtioDev {
+  const char *name;
+  uint32_t device_id;
+  int irq;
+  uint64_t features;
+  int nr_queue;
+  uint32_t rx_queue_mask; // queues only filled by the device, notifications are ignored
+  void *config;
+  uint32_t config_size;
+  virtio_handler_t handler;
+
+  // transport state
+  uint32_t *base;
+  uint64_t driver_features;
+  uint32_t queue_sel;
+  uint32_t status;
+  uint32_t intr_status;
+  VirtioQueue queue[VIRTIO_MAX_QUEUE];
+} VirtioDev;
+
+void virtio_mmio_init(VirtioDev *dev, paddr_t addr, io_callback_t callback);
+void virtio_mmio_access(VirtioDev *dev, uint32_t offset, int len, bool is_write);
+bool virtio_queue_process(VirtioDev *dev, int qid);
+
+#endif
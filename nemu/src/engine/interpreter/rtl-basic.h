@@ -3,6 +3,7 @@
 
 #include "c_op.h"
 #include <memory/vaddr.h>
+#include <cpu/stat.h>
 
 /* RTL basic instructions */
 
@@ -102,14 +103,17 @@ static inline def_rtl(div64s_r, rtlreg_t* dest,
 // memory
 
 static inline def_rtl(lm, rtlreg_t *dest, const rtlreg_t* addr, word_t offset, int len) {
+  IFDEF(CONFIG_INSTR_STAT, g_stat.load[stat_width_idx(len)] ++);
   *dest = vaddr_read(*addr + offset, len);
 }
 
 static inline def_rtl(sm, const rtlreg_t *src1, const rtlreg_t* addr, word_t offset, int len) {
+  IFDEF(CONFIG_INSTR_STAT, g_stat.store[stat_width_idx(len)] ++);
   vaddr_write(*addr + offset, len, *src1);
 }
 
 static inline def_rtl(lms, rtlreg_t *dest, const rtlreg_t* addr, word_t offset, int len) {
+  IFDEF(CONFIG_INSTR_STAT, g_stat.load[stat_width_idx(len)] ++);
   word_t val = vaddr_read(*addr + offset, len);
   switch (len) {
     case 4: *dest = (sword_t)(int32_t)val; return;
@@ -153,6 +157,7 @@ static inline def_rtl(jr, rtlreg_t *target) {
 static inline def_rtl(jrelop, uint32_t relop,
     const rtlreg_t *src1, const rtlreg_t *src2, vaddr_t target) {
   bool is_jmp = interpret_relop(relop, *src1, *src2);
+  IFDEF(CONFIG_INSTR_STAT, g_stat.branch[is_jmp] ++);
   rtl_j(s, (is_jmp ? target : s->snpc));
 }
 #endif
@@ -1,6 +1,6 @@
 #include <cpu/decode.h>
 #include "../local-include/rtl.h"
 
-#define INSTR_LIST(f) f(lui) f(lw) f(sw) f(inv) f(nemu_trap)
+#define INSTR_LIST(f) f(lui) f(lw) f(sw) f(jal) f(jalr) f(csrrw) f(csrrs) f(csrrc) f(mret) f(inv) f(nemu_trap)
 
 def_all_EXEC_ID();
@@ -9,6 +9,7 @@ typedef struct {
   } gpr[32];
 
   vaddr_t pc;
+  word_t mstatus, mtvec, mepc, mcause, mie, mip;
 } riscv32_CPU_state;
 
 // decode
@@ -37,6 +38,15 @@ typedef struct {
       uint32_t rd        : 5;
       uint32_t imm31_12  :20;
     } u;
+    struct {
+      uint32_t opcode1_0 : 2;
+      uint32_t opcode6_2 : 5;
+      uint32_t rd        : 5;
+      uint32_t imm19_12  : 8;
+      uint32_t imm11     : 1;
+      uint32_t imm10_1   :10;
+      int32_t  simm20    : 1;
+    } j;
     uint32_t val;
   } instr;
 } riscv32_ISADecodeInfo;
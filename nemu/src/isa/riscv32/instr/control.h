@@ -0,0 +1,27 @@
+#include <cpu/ftrace.h>
+
+#ifdef CONFIG_FTRACE
+// the calling convention of RISC-V uses x1 (ra) and x5 (t0) as link registers
+#define is_link(r) ((r) == 1 || (r) == 5)
+
+static inline void ftrace_jump(Decode *s, int rd, int rs1) {
+  if (is_link(rd)) ftrace_push(FTRACE_CALL, s->pc, s->dnpc);
+  else if (rd == 0 && is_link(rs1)) ftrace_push(FTRACE_RET, s->pc, s->dnpc);
+  else if (rd == 0 && rs1 != -1) ftrace_push(FTRACE_TAIL, s->pc, s->dnpc);
+}
+#endif
+
+def_EHelper(jal) {
+  rtl_li(s, ddest, s->snpc);
+  rtl_j(s, s->pc + id_src1->imm);
+  IFDEF(CONFIG_FTRACE, ftrace_jump(s, s->isa.instr.j.rd, -1));
+}
+
+def_EHelper(jalr) {
+  // rd may be the same as rs1
+  rtl_addi(s, s0, dsrc1, id_src2->imm);
+  rtl_andi(s, s0, s0, ~1);
+  rtl_li(s, ddest, s->snpc);
+  rtl_jr(s, s0);
+  IFDEF(CONFIG_FTRACE, ftrace_jump(s, s->isa.instr.i.rd, s->isa.instr.i.rs1));
+}
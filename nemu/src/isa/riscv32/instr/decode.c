@@ -40,6 +40,13 @@ static def_DHelper(S) {
   decode_op_r(s, id_dest, s->isa.instr.s.rs2, false);
 }
 
+static def_DHelper(J) {
+  sword_t simm = (s->isa.instr.j.simm20 << 20) | (s->isa.instr.j.imm19_12 << 12) |
+    (s->isa.instr.j.imm11 << 11) | (s->isa.instr.j.imm10_1 << 1);
+  decode_op_i(s, id_src1, simm, false);
+  decode_op_r(s, id_dest, s->isa.instr.j.rd, true);
+}
+
 def_THelper(load) {
   def_INSTR_TAB("??????? ????? ????? 010 ????? ????? ??", lw);
   return EXEC_ID_inv;
@@ -50,10 +57,21 @@ def_THelper(store) {
   return EXEC_ID_inv;
 }
 
+def_THelper(system) {
+  def_INSTR_TAB("0011000 00010 00000 000 00000 ????? ??", mret);
+  def_INSTR_TAB("??????? ????? ????? 001 ????? ????? ??", csrrw);
+  def_INSTR_TAB("??????? ????? ????? 010 ????? ????? ??", csrrs);
+  def_INSTR_TAB("??????? ????? ????? 011 ????? ????? ??", csrrc);
+  return EXEC_ID_inv;
+}
+
 def_THelper(main) {
   def_INSTR_IDTAB("??????? ????? ????? ??? ????? 00000 11", I     , load);
   def_INSTR_IDTAB("??????? ????? ????? ??? ????? 01000 11", S     , store);
   def_INSTR_IDTAB("??????? ????? ????? ??? ????? 01101 11", U     , lui);
+  def_INSTR_IDTAB("??????? ????? ????? ??? ????? 11011 11", J     , jal);
+  def_INSTR_IDTAB("??????? ????? ????? 000 ????? 11001 11", I     , jalr);
+  def_INSTR_IDTAB("??????? ????? ????? ??? ????? 11100 11", I     , system);
   def_INSTR_TAB  ("??????? ????? ????? ??? ????? 11010 11",         nemu_trap);
   return table_inv(s);
 };
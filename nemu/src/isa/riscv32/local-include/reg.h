@@ -10,6 +10,25 @@ static inline int check_reg_idx(int idx) {
 
 #define gpr(idx) (cpu.gpr[check_reg_idx(idx)]._32)
 
+enum {
+  CSR_MSTATUS = 0x300, CSR_MIE = 0x304, CSR_MTVEC = 0x305,
+  CSR_MEPC = 0x341, CSR_MCAUSE = 0x342, CSR_MIP = 0x344,
+};
+
+// return NULL for the CSRs not implemented
+#define csr(addr) ({ \
+  word_t *__p = NULL; \
+  switch (addr) { \
+    case CSR_MSTATUS: __p = &cpu.mstatus; break; \
+    case CSR_MIE:     __p = &cpu.mie;     break; \
+    case CSR_MTVEC:   __p = &cpu.mtvec;   break; \
+    case CSR_MEPC:    __p = &cpu.mepc;    break; \
+    case CSR_MCAUSE:  __p = &cpu.mcause;  break; \
+    case CSR_MIP:     __p = &cpu.mip;     break; \
+  } \
+  __p; \
+})
+
 static inline const char* reg_name(int idx, int width) {
   extern const char* regs[];
   return regs[check_reg_idx(idx)];
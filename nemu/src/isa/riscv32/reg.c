@@ -11,6 +11,20 @@ const char *regs[] = {
 void isa_reg_display() {
 }
 
+// `s` may be given with or without the leading '$'
+word_t *isa_reg_str2ptr(const char *s) {
+  if (s[0] == '$') s ++;
+  if (strcmp(s, "pc") == 0) return &cpu.pc;
+  int i;
+  for (i = 0; i < 32; i ++) {
+    const char *name = (regs[i][0] == '$' ? regs[i] + 1 : regs[i]);
+    if (strcmp(s, name) == 0) return &cpu.gpr[i]._32;
+  }
+  return NULL;
+}
+
 word_t isa_reg_str2val(const char *s, bool *success) {
-  return 0;
+  word_t *reg = isa_reg_str2ptr(s);
+  *success = (reg != NULL);
+  return (reg ? *reg : 0);
 }
@@ -1,10 +1,47 @@
 #include <isa.h>
 #include <cpu/difftest.h>
+#include <memory/paddr.h>
 #include "../local-include/reg.h"
 
+// compare the GPRs and pc of REF with DUT, without reporting
 bool isa_difftest_checkregs(CPU_state *ref_r, vaddr_t pc) {
-  return false;
+  int i;
+  for (i = 0; i < 32; i ++) {
+    if (ref_r->gpr[i]._64 != gpr(i)) return false;
+  }
+  return ref_r->pc == cpu.pc;
 }
 
+#define I_TYPE(imm, rs1, funct3, rd, opcode) \
+  (((uint32_t)(imm) << 20) | ((rs1) << 15) | ((funct3) << 12) | ((rd) << 7) | (opcode))
+
+// The CSRs are not copied by ref_difftest_regcpy(), so they are written by
+// running csrw instructions in REF. The code and the values are put at
+// RESET_VECTOR, whose content in REF is restored after that. mip is left
+// alone, since it reflects the devices. mstatus is written last, since it
+// may enable interrupts.
 void isa_difftest_attach() {
+  static const uint32_t csr_addr[] = { CSR_MTVEC, CSR_MEPC, CSR_MCAUSE, CSR_MIE, CSR_MSTATUS };
+  enum { NR_CSR = ARRLEN(csr_addr), NR_INSTR = 1 + 2 * NR_CSR };
+  struct {
+    uint32_t code[NR_INSTR + 1]; // padded to align the values
+    word_t val[NR_CSR];
+  } buf;
+  int i;
+  buf.code[0] = 0x00000297; // auipc t0, 0
+  for (i = 0; i < NR_CSR; i ++) {
+    // ld t1, val[i](t0); csrw csr_addr[i], t1
+    buf.code[1 + 2 * i] = I_TYPE((uint8_t *)&buf.val[i] - (uint8_t *)&buf, 5, 3, 6, 0x03);
+    buf.code[2 + 2 * i] = I_TYPE(csr_addr[i], 6, 1, 0, 0x73);
+    buf.val[i] = *csr(csr_addr[i]);
+  }
+  buf.code[NR_INSTR] = 0;
+
+  CPU_state ref_r = cpu;
+  ref_r.pc = RESET_VECTOR;
+  ref_difftest_memcpy(RESET_VECTOR, &buf, sizeof(buf), DIFFTEST_TO_REF);
+  ref_difftest_regcpy(&ref_r, DIFFTEST_TO_REF);
+  ref_difftest_exec(NR_INSTR);
+  // the GPRs and pc are copied to REF by the caller
+  ref_difftest_memcpy(RESET_VECTOR, guest_to_host(RESET_VECTOR), sizeof(buf), DIFFTEST_TO_REF);
 }
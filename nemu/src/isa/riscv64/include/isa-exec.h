@@ -1,3 +1,5 @@
 #include "../instr/compute.h"
 #include "../instr/ldst.h"
+#include "../instr/control.h"
+#include "../instr/system.h"
 #include "../instr/special.h"
@@ -0,0 +1,26 @@
+#include <cpu/cpu.h>
+
+word_t intr_return();
+
+// The old value goes to rd after the new value is computed, since rd may
+// be the same as rs1. mip is driven by the interrupt lines, so writes to it
+// are ignored. A write may enable a pending interrupt, so it is checked
+// after the instruction.
+#define def_csr_EHelper(name, new_val) \
+  def_EHelper(name) { \
+    word_t *c = csr(id_src2->imm & 0xfff); \
+    if (c == NULL) { rtl_hostcall(s, HOSTCALL_INV, NULL, NULL, NULL, 0); return; } \
+    word_t old = *c; \
+    if (c != &cpu.mip) *c = (new_val); \
+    rtl_li(s, ddest, old); \
+    cpu_kick_intr_check(); \
+  }
+
+def_csr_EHelper(csrrw, *dsrc1)
+def_csr_EHelper(csrrs, old | *dsrc1)
+def_csr_EHelper(csrrc, old & ~*dsrc1)
+
+def_EHelper(mret) {
+  rtl_j(s, intr_return());
+  cpu_kick_intr_check();
+}
@@ -1,13 +1,47 @@
 #include <isa.h>
 
+#define MSTATUS_MIE  (1 << 3)
+#define MSTATUS_MPIE (1 << 7)
+#define INTR_BIT (1ull << (sizeof(word_t) * 8 - 1))
+
+enum { IRQ_MSI = 3, IRQ_MTI = 7, IRQ_MEI = 11 };
+
+static const int line2irq[] = {
+  [INTR_LINE_SOFT] = IRQ_MSI,
+  [INTR_LINE_TIMER] = IRQ_MTI,
+  [INTR_LINE_EXTERNAL] = IRQ_MEI,
+};
+
 word_t isa_raise_intr(word_t NO, vaddr_t epc) {
-  /* TODO: Trigger an interrupt/exception with ``NO''.
-   * Then return the address of the interrupt/exception vector.
-   */
+  cpu.mcause = NO;
+  cpu.mepc = epc;
+  // MPIE <- MIE, MIE <- 0
+  cpu.mstatus = (cpu.mstatus & ~MSTATUS_MPIE) | ((cpu.mstatus & MSTATUS_MIE) ? MSTATUS_MPIE : 0);
+  cpu.mstatus &= ~MSTATUS_MIE;
+  return cpu.mtvec;
+}
 
-  return 0;
+// mret: MIE <- MPIE, MPIE <- 1
+word_t intr_return() {
+  cpu.mstatus = (cpu.mstatus & ~MSTATUS_MIE) | ((cpu.mstatus & MSTATUS_MPIE) ? MSTATUS_MIE : 0);
+  cpu.mstatus |= MSTATUS_MPIE;
+  return cpu.mepc;
 }
 
 word_t isa_query_intr() {
+  if (!(cpu.mstatus & MSTATUS_MIE)) return INTR_EMPTY;
+  word_t pending = cpu.mip & cpu.mie;
+  if (pending == 0) return INTR_EMPTY;
+  // MEI > MSI > MTI
+  static const int order[] = { IRQ_MEI, IRQ_MSI, IRQ_MTI };
+  int i;
+  for (i = 0; i < ARRLEN(order); i ++) {
+    if (pending & ((word_t)1 << order[i])) return INTR_BIT | order[i];
+  }
   return INTR_EMPTY;
 }
+
+void isa_set_intr_line(int line, bool level) {
+  word_t mask = (word_t)1 << line2irq[line];
+  cpu.mip = (level ? cpu.mip | mask : cpu.mip & ~mask);
+}
@@ -1,5 +1,6 @@
 #include <memory/host.h>
 #include <memory/paddr.h>
+#include <memory/vaddr.h>
 #include <device/mmio.h>
 #include <isa.h>
 
@@ -17,7 +18,40 @@ static word_t pmem_read(paddr_t addr, int len) {
   return ret;
 }
 
+// The hook is called before the first write to a page since the last
+// reset, so it can still see the old content of the page.
+#define NR_PAGE (CONFIG_MSIZE / PAGE_SIZE)
+static bool track_writes = false;
+static pmem_write_hook_t write_hook = NULL;
+static uint8_t page_written[NR_PAGE] = {};
+static uint32_t written_list[NR_PAGE] = {};
+static uint32_t nr_written = 0;
+
+void pmem_track_writes(pmem_write_hook_t hook) {
+  pmem_track_reset();
+  write_hook = hook;
+  track_writes = (hook != NULL);
+}
+
+void pmem_track_reset() {
+  while (nr_written > 0) {
+    page_written[written_list[-- nr_written]] = 0;
+  }
+}
+
+static void track_page(paddr_t addr) {
+  uint32_t idx = (addr - CONFIG_MBASE) / PAGE_SIZE;
+  if (page_written[idx]) return;
+  page_written[idx] = 1;
+  written_list[nr_written ++] = idx;
+  write_hook(CONFIG_MBASE + (paddr_t)idx * PAGE_SIZE);
+}
+
 static void pmem_write(paddr_t addr, int len, word_t data) {
+  if (unlikely(track_writes)) {
+    track_page(addr);
+    if (addr + len - 1 < (paddr_t)CONFIG_MBASE + CONFIG_MSIZE) track_page(addr + len - 1);
+  }
   host_write(guest_to_host(addr), len, data);
 }
 
@@ -8,6 +8,11 @@ void init_difftest(char *ref_so_file, long img_size, int port);
 void init_device();
 void init_sdb();
 void init_disasm(const char *triple);
+void init_symtab(const char *elf_file);
+void init_ftrace(const char *file);
+void init_profile(const char *file);
+void stat_set_file(const char *file);
+void init_iringbuf(const char *file, const char *triple);
 
 static void welcome() {
   Log("Trace: %s", MUXDEF(CONFIG_TRACE, ASNI_FMT("ON", ASNI_FG_GREEN), ASNI_FMT("OFF", ASNI_FG_RED)));
@@ -25,10 +30,17 @@ static void welcome() {
 #include <getopt.h>
 
 void sdb_set_batch_mode();
+void sdb_set_gdb_port(int port);
+void i8042_set_script(const char *replay, const char *record);
+void difftest_set_golden(const char *file, bool record);
 
 static char *log_file = NULL;
 static char *diff_so_file = NULL;
 static char *img_file = NULL;
+static char *elf_file = NULL;
+static char *ftrace_file = NULL;
+static char *profile_file = NULL;
+static char *itrace_file = NULL;
 static int difftest_port = 1234;
 
 static long load_img() {
@@ -59,16 +71,36 @@ static int parse_args(int argc, char *argv[]) {
     {"log"      , required_argument, NULL, 'l'},
     {"diff"     , required_argument, NULL, 'd'},
     {"port"     , required_argument, NULL, 'p'},
+    {"key-replay", required_argument, NULL, 'k'},
+    {"key-record", required_argument, NULL, 'K'},
+    {"golden"   , required_argument, NULL, 'g'},
+    {"golden-record", required_argument, NULL, 'G'},
+    {"gdb"      , required_argument, NULL, 'r'},
+    {"elf"      , required_argument, NULL, 'e'},
+    {"ftrace"   , required_argument, NULL, 'f'},
+    {"profile"  , required_argument, NULL, 'P'},
+    {"stat"     , required_argument, NULL, 's'},
+    {"itrace"   , required_argument, NULL, 'i'},
     {"help"     , no_argument      , NULL, 'h'},
     {0          , 0                , NULL,  0 },
   };
   int o;
-  while ( (o = getopt_long(argc, argv, "-bhl:d:p:", table, NULL)) != -1) {
+  while ( (o = getopt_long(argc, argv, "-bhl:d:p:k:K:g:G:r:e:f:P:s:i:", table, NULL)) != -1) {
     switch (o) {
       case 'b': sdb_set_batch_mode(); break;
       case 'p': sscanf(optarg, "%d", &difftest_port); break;
       case 'l': log_file = optarg; break;
       case 'd': diff_so_file = optarg; break;
+      case 'k': IFDEF(CONFIG_HAS_KEYBOARD, i8042_set_script(optarg, NULL)); break;
+      case 'K': IFDEF(CONFIG_HAS_KEYBOARD, i8042_set_script(NULL, optarg)); break;
+      case 'g': difftest_set_golden(optarg, false); break;
+      case 'G': difftest_set_golden(optarg, true); break;
+      case 'r': sdb_set_gdb_port(atoi(optarg)); break;
+      case 'e': elf_file = optarg; break;
+      case 'f': ftrace_file = optarg; break;
+      case 'P': profile_file = optarg; break;
+      case 's': IFDEF(CONFIG_INSTR_STAT, stat_set_file(optarg)); break;
+      case 'i': itrace_file = optarg; break;
       case 1: img_file = optarg; return optind - 1;
       default:
         printf("Usage: %s [OPTION...] IMAGE [args]\n\n", argv[0]);
@@ -76,6 +108,16 @@ static int parse_args(int argc, char *argv[]) {
         printf("\t-l,--log=FILE           output log to FILE\n");
         printf("\t-d,--diff=REF_SO        run DiffTest with reference REF_SO\n");
         printf("\t-p,--port=PORT          run DiffTest with port PORT\n");
+        printf("\t-k,--key-replay=FILE    replay key events from FILE\n");
+        printf("\t-K,--key-record=FILE    record key events to FILE\n");
+        printf("\t-g,--golden=TRACE       run DiffTest against the golden trace TRACE\n");
+        printf("\t-G,--golden-record=TRACE  record the golden trace of REF to TRACE\n");
+        printf("\t-r,--gdb=PORT           serve the GDB remote protocol on PORT\n");
+        printf("\t-e,--elf=FILE           load the symbols from the ELF FILE\n");
+        printf("\t-f,--ftrace=FILE        write the function trace to FILE\n");
+        printf("\t-P,--profile=FILE       write the sampling profile to FILE\n");
+        printf("\t-s,--stat=FILE          write the instruction statistics to FILE at exit\n");
+        printf("\t-i,--itrace=FILE        write the instructions executed to FILE\n");
         printf("\n");
         exit(0);
     }
@@ -110,15 +152,28 @@ void init_monitor(int argc, char *argv[]) {
   /* Initialize differential testing. */
   init_difftest(diff_so_file, img_size, difftest_port);
 
+  /* Load the symbol table of the guest program. */
+  init_symtab(elf_file);
+
+  /* Open the function trace. */
+  IFDEF(CONFIG_FTRACE, init_ftrace(ftrace_file));
+
+  /* Start the sampling profiler. */
+  IFDEF(CONFIG_PROFILE, init_profile(profile_file));
+
   /* Initialize the simple debugger. */
   init_sdb();
 
-  IFDEF(CONFIG_ITRACE, init_disasm(
-    MUXDEF(CONFIG_ISA_x86,     "i686",
-    MUXDEF(CONFIG_ISA_mips32,  "mipsel",
-    MUXDEF(CONFIG_ISA_riscv32, "riscv32",
+#define GUEST_TRIPLE \
+    MUXDEF(CONFIG_ISA_x86,     "i686", \
+    MUXDEF(CONFIG_ISA_mips32,  "mipsel", \
+    MUXDEF(CONFIG_ISA_riscv32, "riscv32", \
     MUXDEF(CONFIG_ISA_riscv64, "riscv64", "bad")))) "-pc-linux-gnu"
-  ));
+
+  IFDEF(CONFIG_ITRACE, init_disasm(GUEST_TRIPLE));
+
+  /* Open the binary instruction trace. */
+  IFDEF(CONFIG_IRINGBUF, init_iringbuf(itrace_file, GUEST_TRIPLE));
 
   /* Display welcome message. */
   welcome();
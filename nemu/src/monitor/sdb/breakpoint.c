@@ -0,0 +1,149 @@
+#include "sdb.h"
+
+#define NR_BP 32
+// the hash table is kept sparse, so that a miss almost always costs a single probe
+#define NR_SLOT 256
+
+typedef struct breakpoint {
+  int NO;
+  bool used;
+  vaddr_t addr;
+  char cond[64];  // the condition, empty if none
+  ExprCode code;  // the condition compiled
+  uint64_t hit;   // times the condition is true at addr
+} BP;
+
+static BP bp_pool[NR_BP] = {};
+static BP *slot[NR_SLOT] = {};
+static int nr_bp = 0;
+
+static inline uint32_t slot_idx(vaddr_t addr) {
+  return (addr >> 2) % NR_SLOT;
+}
+
+static void rebuild_slots() {
+  int i;
+  memset(slot, 0, sizeof(slot));
+  for (i = 0; i < NR_BP; i ++) {
+    BP *bp = &bp_pool[i];
+    if (!bp->used) continue;
+    uint32_t idx = slot_idx(bp->addr);
+    while (slot[idx] != NULL) idx = (idx + 1) % NR_SLOT;
+    slot[idx] = bp;
+  }
+}
+
+void init_bp_pool() {
+  int i;
+  for (i = 0; i < NR_BP; i ++) {
+    bp_pool[i].NO = i;
+    bp_pool[i].used = false;
+  }
+  nr_bp = 0;
+  rebuild_slots();
+}
+
+// b ADDR [if EXPR]
+void add_bp(char *args, bool *success) {
+  *success = false;
+  char *cond = strstr(args, " if ");
+  if (cond != NULL) {
+    *cond = '\0';
+    cond += 4;
+  }
+
+  vaddr_t addr = expr(args, success);
+  if (!*success) return;
+
+  static ExprCode code;
+  code.nr_inst = 0;
+  if (cond != NULL && !expr_compile(cond, &code)) { *success = false; return; }
+
+  int i;
+  for (i = 0; i < NR_BP; i ++) {
+    if (bp_pool[i].used && bp_pool[i].addr == addr) {
+      printf("Breakpoint %d is already at " FMT_WORD "\n", i, addr);
+      *success = false;
+      return;
+    }
+  }
+  for (i = 0; i < NR_BP && bp_pool[i].used; i ++);
+  if (i == NR_BP) { printf("Too many breakpoints\n"); *success = false; return; }
+
+  BP *bp = &bp_pool[i];
+  bp->used = true;
+  bp->addr = addr;
+  bp->hit = 0;
+  bp->code = code;
+  snprintf(bp->cond, sizeof(bp->cond), "%s", (cond ? cond : ""));
+  nr_bp ++;
+  rebuild_slots();
+  printf("Breakpoint %d at " FMT_WORD "\n", bp->NO, addr);
+}
+
+bool delete_bp(int NO) {
+  if (NO < 0 || NO >= NR_BP || !bp_pool[NO].used) return false;
+  bp_pool[NO].used = false;
+  nr_bp --;
+  rebuild_slots();
+  return true;
+}
+
+bool delete_bp_at(vaddr_t addr) {
+  int i;
+  for (i = 0; i < NR_BP; i ++) {
+    if (bp_pool[i].used && bp_pool[i].addr == addr) return delete_bp(i);
+  }
+  return false;
+}
+
+void bp_display() {
+  if (nr_bp == 0) {puts("No breakpoint yet"); return;}
+  printf("%-8s%-20s%-12s%s\n", "Num", "Address", "Hits", "Condition");
+  int i;
+  for (i = 0; i < NR_BP; i ++) {
+    BP *bp = &bp_pool[i];
+    if (!bp->used) continue;
+    printf("%-8d" FMT_WORD "  %-12lu%s\n", bp->NO, bp->addr, bp->hit, bp->cond);
+  }
+}
+
+static bool bp_hit(BP *bp) {
+  if (bp->code.nr_inst != 0) {
+    bool success;
+    word_t val = expr_eval(&bp->code, &success, NULL);
+    // an invalid condition stops the guest, so that the user can see it
+    if (success && val == 0) return false;
+  }
+  bp->hit ++;
+  printf("Breakpoint %d at " FMT_WORD " hit %lu time(s)\n", bp->NO, bp->addr, bp->hit);
+  return true;
+}
+
+static BP* bp_find(vaddr_t pc) {
+  uint32_t idx = slot_idx(pc);
+  BP *bp;
+  while ((bp = slot[idx]) != NULL) {
+    if (bp->addr == pc) return bp;
+    idx = (idx + 1) % NR_SLOT;
+  }
+  return NULL;
+}
+
+// called with the pc of the next instruction, return true to stop before it
+bool bp_check(vaddr_t pc) {
+  if (likely(nr_bp == 0)) return false;
+  BP *bp = bp_find(pc);
+  return bp != NULL && bp_hit(bp);
+}
+
+// the same as bp_check(), but without counting and printing
+bool bp_match(vaddr_t pc) {
+  if (likely(nr_bp == 0)) return false;
+  BP *bp = bp_find(pc);
+  if (bp == NULL) return false;
+  if (bp->code.nr_inst == 0) return true;
+  bool success;
+  word_t val = expr_eval(&bp->code, &success, NULL);
+  return !success || val != 0;
+}
@@ -1,324 +1,332 @@
 #include <isa.h>
-
-/* We use the POSIX regex functions to process regular expressions.
- * Type 'man regex' for more information about POSIX regex functions.
+#include <memory/host.h>
+#include <memory/paddr.h>
+#include <memory/vaddr.h>
+#include <utils.h>
+#include "sdb.h"
+
+/* An expression is scanned by a hand-written lexer in a single pass, and
+ * the parser compiles it into a stack bytecode while reading the tokens.
+ * Registers are resolved at compile time, so evaluating the bytecode only
+ * loads the values and never touches the text of the expression again.
  */
-#include <regex.h>
-
-#include "memory/vaddr.h"
 
 enum {
-	NOTYPE = 256, EQ, NEQ, NUM, HEX, REG, SYMB, LS, RS, NG, NL, AND, OR, DEREF, NEG
+	NOTYPE = 256, EQ, NEQ, NUM, HEX, REG, SYMB, LS, RS, NG, NL, AND, OR, DEREF, NEG, END
+};
 
-  /* TODO: Add more token types */
+typedef struct token {
+  int type;
+  char *str; // a slice of the expression, not terminated
+  int len;
+} Token;
 
-};
+static char *expr_str = NULL;  // the expression being compiled
+static char *pos = NULL;       // the first character not scanned yet
+static char *tok_start = NULL; // where `tok' starts
+static Token tok = {};
+static bool compile_ok = true;
+
+static void syntax_error(const char *msg) {
+  if (!compile_ok) return;  // only report the first error
+  int position = tok_start - expr_str;
+  printf("%s at position %d\n%s\n%*.s^\n", msg, position, expr_str, position, "");
+  compile_ok = false;
+}
 
-static struct rule {
-  const char *regex;
-  int token_type;
-} rules[] = {
-
-  /* TODO: Add more rules.
-   * Pay attention to the precedence level of different rules.
-   */
-
-  // {" +", TK_NOTYPE},    // spaces
-  // {"\\+", '+'},         // plus
-  // {"==", TK_EQ},        // equal
-
-	{" +",	NOTYPE},				// white space
-	{"\\+", '+'},
-	{"\\-", '-'},
-	{"==", EQ},
-	{"!=",NEQ},
-	{"0[x,X][0-9a-fA-F]+", HEX},
-	{"[0-9]+", NUM},
-  {"\\$pc|\\$0|\\$at|\\$ra|\\$gp|\\$sp|\\$v[0-1]|\\$a[0-3]|\\$t[0-9]|\\$s[0-8]|\\$k[0-1]", REG},
-	{"[a-zA-Z]+[a-zA-Z0-9_]*", SYMB},
-	{"\\*", '*'},
-	{"/", '/'},
-	{"%", '%'},
-	{"\\(", '('},
-	{"\\)", ')'},
-	{"<<", LS},						//left shift
-	{">>", RS},						//right shift
-	{"<=", NG},						//not greater than
-	{">=", NL},						//not less than
-	{"<", '<'},
-	{">", '>'},
-	{"&&",AND},
-	{"\\|\\|",OR},
-	{"&",'&'},
-	{"\\^",'^'},
-	{"\\|",'|'},
-	{"!",'!'},
-	{"~",'~'},
+// `.' appears in the names of symbols such as `foo.part.0'
+static bool is_ident(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+    c == '_' || c == '.';
+}
 
-};
+// the text of `tok' as a string, valid until the next call
+static char *tok_text() {
+  static char *buf = NULL;
+  static int size = 0;
+  if (tok.len >= size) {
+    size = tok.len + 1;
+    buf = realloc(buf, size);
+    assert(buf);
+  }
+  memcpy(buf, tok.str, tok.len);
+  buf[tok.len] = '\0';
+  return buf;
+}
+
+static void next_token() {
+  while (*pos == ' ' || *pos == '\t' || *pos == '\n') pos ++;
+  tok_start = pos;
+  tok.str = pos;
+  tok.len = 0;
+
+  char c = *pos;
+  if (c == '\0') { tok.type = END; return; }
+
+  if (is_ident(c) || c == '$') {
+    char *start = pos ++;
+    while (is_ident(*pos)) pos ++;
+    tok.len = pos - start;
+    if (c == '$') tok.type = REG;
+    else if (c >= '0' && c <= '9') tok.type = (c == '0' && (start[1] == 'x' || start[1] == 'X') ? HEX : NUM);
+    else tok.type = SYMB;
+    return;
+  }
 
-#define NR_REGEX ARRLEN(rules)
+  pos ++;
+  char n = *pos;
+  switch (c) {
+    case '=': if (n == '=') { pos ++; tok.type = EQ; return; } break;
+    case '!': if (n == '=') { pos ++; tok.type = NEQ; return; } tok.type = '!'; return;
+    case '<': if (n == '<') { pos ++; tok.type = LS; return; }
+              if (n == '=') { pos ++; tok.type = NG; return; } tok.type = '<'; return;
+    case '>': if (n == '>') { pos ++; tok.type = RS; return; }
+              if (n == '=') { pos ++; tok.type = NL; return; } tok.type = '>'; return;
+    case '&': if (n == '&') { pos ++; tok.type = AND; return; } tok.type = '&'; return;
+    case '|': if (n == '|') { pos ++; tok.type = OR; return; } tok.type = '|'; return;
+    case '+': case '-': case '*': case '/': case '%':
+    case '^': case '~': case '(': case ')':
+      tok.type = c; return;
+  }
+  syntax_error("no match");
+  tok.type = END;
+}
 
-static regex_t re[NR_REGEX] = {};
+/* bytecode */
+
+enum {
+  OP_IMM, OP_REG, OP_DEREF, OP_NEG, OP_NOT, OP_BNOT,
+  OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_REM, OP_SHL, OP_SHR,
+  OP_LT, OP_GT, OP_LE, OP_GE, OP_EQ, OP_NE,
+  OP_AND, OP_XOR, OP_OR, OP_LAND, OP_LOR,
+};
 
+static ExprCode *code = NULL;
 
-/* Rules are used for many times.
- * Therefore we compile them only once before any usage.
- */
-void init_regex() {
-  int i;
-  char error_msg[128];
-  int ret;
-
-  for (i = 0; i < NR_REGEX; i ++) {
-    ret = regcomp(&re[i], rules[i].regex, REG_EXTENDED);
-    if (ret != 0) {
-      regerror(ret, &re[i], error_msg, 128);
-      panic("regex compilation failed: %s\n%s", error_msg, rules[i].regex);
-    }
+static void emit(int op, word_t imm, word_t *reg) {
+  if (code->nr_inst == EXPR_MAX_INST) {
+    syntax_error("expression too long");
+    return;
   }
+  ExprInst *i = &code->inst[code->nr_inst ++];
+  i->op = op;
+  if (op == OP_REG) i->reg = reg;
+  else i->imm = imm;
 }
 
-typedef struct token {
-  int type;
-  char str[32];
-} Token;
+/* parser */
 
-static Token tokens[32] __attribute__((used)) = {};
-static int nr_token __attribute__((used))  = 0;
+// a larger priority binds less tightly
+static const struct {
+  int token_type;
+  int priority;
+  int op;
+} binary_ops[] = {
+	{OR, 12, OP_LOR},
+	{AND, 11, OP_LAND},
+	{'|', 10, OP_OR},
+	{'^', 9, OP_XOR},
+	{'&', 8, OP_AND},
+	{EQ, 7, OP_EQ},
+	{NEQ, 7, OP_NE},
+	{'>', 6, OP_GT},
+	{'<', 6, OP_LT},
+	{NG, 6, OP_LE},
+	{NL, 6, OP_GE},
+	{LS, 5, OP_SHL},
+	{RS, 5, OP_SHR},
+	{'+', 4, OP_ADD},
+	{'-', 4, OP_SUB},
+	{'*', 3, OP_MUL},
+	{'/', 3, OP_DIV},
+	{'%', 3, OP_REM},
+};
+#define MAX_PRIORITY 12
 
-static bool make_token(char *e) {
-  int position = 0;
+static int find_binary_op(int type) {
   int i;
-  regmatch_t pmatch;
-
-  nr_token = 0;
-
-  while (e[position] != '\0') {
-    /* Try all rules one by one. */
-    for (i = 0; i < NR_REGEX; i ++) {
-      if (regexec(&re[i], e + position, 1, &pmatch, 0) == 0 && pmatch.rm_so == 0) {
-        char *substr_start = e + position;
-        int substr_len = pmatch.rm_eo;
-
-        Log("match rules[%d] = \"%s\" at position %d with len %d: %.*s",
-            i, rules[i].regex, position, substr_len, substr_len, substr_start);
-
-        position += substr_len;
-
-        /* TODO: Now a new token is recognized with rules[i]. Add codes
-         * to record the token in the array `tokens'. For certain types
-         * of tokens, some extra actions should be performed.
-         */
-      
-        int j;
-				switch(rules[i].token_type) {
-					case NOTYPE:break;
-					case REG:
-					case NUM: 
-					case HEX:
-					case SYMB:
-							for(j=0;j<substr_len;j++)
-							{
-								tokens[nr_token].str[j]=*(substr_start+j);
-							}
-							tokens[nr_token].str[j]='\0';
-					default: 
-							tokens[nr_token].type = rules[i].token_type;
-							nr_token ++;
-				}
-
-				break;
-      }
-    }
+  for (i = 0; i < ARRLEN(binary_ops); i ++) {
+    if (binary_ops[i].token_type == type) return i;
+  }
+  return -1;
+}
 
-    if (i == NR_REGEX) {
-      printf("no match at position %d\n%s\n%*.s^\n", position, e, position, "");
-      return false;
-    }
+static void parse_expr(int max_priority);
+
+static void parse_primary() {
+  char *end;
+  word_t *reg;
+  vaddr_t addr;
+  switch (tok.type) {
+    case NUM:
+    case HEX:
+      emit(OP_IMM, strtoull(tok_text(), &end, tok.type == HEX ? 16 : 10), NULL);
+      if (*end != '\0') { syntax_error("bad number"); return; }
+      next_token();
+      return;
+    case REG:
+      reg = isa_reg_str2ptr(tok_text());
+      if (reg == NULL) { syntax_error("unknown register"); return; }
+      emit(OP_REG, 0, reg);
+      next_token();
+      return;
+    case SYMB:
+      if (!symtab_lookup(tok_text(), &addr)) { syntax_error("unknown symbol"); return; }
+      emit(OP_IMM, addr, NULL);
+      next_token();
+      return;
+    case '(':
+      next_token();
+      parse_expr(MAX_PRIORITY);
+      if (tok.type != ')') { syntax_error("expect ')'"); return; }
+      next_token();
+      return;
+    default:
+      syntax_error("expect an operand");
   }
+}
 
-  return true;
+// unary operators have priority 2
+static void parse_unary() {
+  int op;
+  switch (tok.type) {
+    case '-': op = OP_NEG; break;
+    case '*': op = OP_DEREF; break;
+    case '!': op = OP_NOT; break;
+    case '~': op = OP_BNOT; break;
+    default: parse_primary(); return;
+  }
+  next_token();
+  parse_unary();
+  emit(op, 0, NULL);
 }
 
-static struct Node {
-	int operand;
-	int priority;
-} table[] = {
-	{OR,12},
-	{AND,11},
-	{'|',10},
-	{'^',9},
-	{'&',8},
-	{EQ,7},
-	{NEQ,7},
-	{'>',6},
-	{'<',6},
-	{NG,6},
-	{NL,6},
-	{LS,5},
-	{RS,5},
-	{'+',4},
-	{'-',4},
-	{'*',3},
-	{'/',3},
-	{'%',3},
-	{'!',2},
-	{'~',2},
-	{DEREF,2},
-	{NEG,2},
-};
-int NR_TABLE = sizeof(table) / sizeof(table[0]);
-
-int check_parentheses(int p, int q) {
-	int i,j=0;
-	for(i=p;i<q;i++)
-	{
-		if(tokens[i].type=='(')
-			j++;
-		else if(tokens[i].type==')')
-			j--;
-		if(j==0)
-			return 0;
-	}
-	if(tokens[q].type==')')
-		j--;
-	return (j==0)&&(tokens[p].type=='(')&&(tokens[q].type==')');
+// parse the operators with priority <= max_priority, left associatively
+static void parse_expr(int max_priority) {
+  parse_unary();
+  while (compile_ok) {
+    int i = find_binary_op(tok.type);
+    if (i == -1 || binary_ops[i].priority > max_priority) return;
+    next_token();
+    parse_expr(binary_ops[i].priority - 1);
+    emit(binary_ops[i].op, 0, NULL);
+  }
 }
 
-int isoperand(int i){
-	return tokens[i].type!=NOTYPE && tokens[i].type!=NUM && tokens[i].type!=REG && tokens[i].type!=SYMB && tokens[i].type!=HEX && tokens[i].type!='(' && tokens[i].type!=')';
+bool expr_compile(char *e, ExprCode *c) {
+  expr_str = pos = tok_start = e;
+  code = c;
+  code->nr_inst = 0;
+  compile_ok = true;
+
+  next_token();
+  parse_expr(MAX_PRIORITY);
+  if (compile_ok && tok.type != END) syntax_error("unexpected token");
+  return compile_ok;
 }
-uint32_t eval(int p,int q,bool *success) {
-	if(p > q) {
-	/* Bad expression */
-		*success=false;
-		return 0;
-	}
-	else if(p == q) { 
-	/* Single token.
-	* For now this token should be a number. 
-	* Return the value of the number.
-	*/ 
-		if(tokens[p].type==HEX)
-		{
-			uint32_t result=0;
-			sscanf(tokens[p].str,"%x",&result);
-			return result;
-		}
-		else if(tokens[p].type==NUM)
-		{
-			uint32_t result=0;
-			sscanf(tokens[p].str,"%d",&result);
-			return result;
-		}
-		else if(tokens[p].type==REG)
-		{
-			if(tokens[p].str[2]=='0')
-				return cpu.gpr[0]._64;
-			else if(tokens[p].str[2]=='r'&&tokens[p].str[3]=='a')
-				return cpu.gpr[1]._64;
-			else if(tokens[p].str[2]=='s'&&tokens[p].str[p]=='p')
-				return cpu.gpr[2]._64;
-			else if(tokens[p].str[2]=='g'&&tokens[p].str[2]=='p')
-				return cpu.gpr[3]._64;
-			else if(tokens[p].str[2]=='t'&&tokens[p].str[3]=='p')
-				return cpu.gpr[4]._64;
-			else
-				return cpu.pc;
-		}
-		// else
-		// 	return look_up_symtab(tokens[p].str, success);
-	}
-	else if(check_parentheses(p, q) == true) {
-	/* The expression is surrounded by a matched pair of parentheses. 
-	* If that is the case, just throw away the parentheses.
-	*/
-		return eval(p + 1, q - 1,success); 
-	}
-	else {
-		int op=-1;
-		int op_priority=0;
-		int i;
-		for(i=p;i<=q;i++)
-		{
-			if(tokens[i].type=='(')
-			{
-				int k=1;
-				while(k!=0)
-				{
-					i++;
-					if(tokens[i].type=='(')
-						k++;
-					else if(tokens[i].type==')')
-						k--;
-				}
-			}
-			else if(isoperand(i))
-			{
-				int j;
-				for(j=0;j<NR_TABLE;j++)
-					if(table[j].operand==tokens[i].type)
-						break;
-				if(table[j].priority>=op_priority)
-				{
-					op_priority=table[j].priority;
-					op=i;
-				}
-			}
-		}
-		int op_type=tokens[op].type;
-		uint32_t val1=0,val2=0;
-		if(op_type!='!'&&op_type!='~'&&op_type!=NEG&&op_type!=DEREF)
-			val1 = eval(p, op - 1, success);
-		val2 = eval(op + 1, q, success);
-		switch(op_type) {
-			case '+': return val1 + val2;break;
-			case '-': return val1 - val2;break;
-			case '*': return val1 * val2;break;
-			case '/': return val1 / val2;break;
-			case '%': return val1 % val2;break;
-			case LS: return val1 << val2;break;
-			case RS: return val1 >> val2;break;
-			case '>': return val1 > val2;break;
-			case '<': return val1 < val2;break;
-			case NG: return val1 <= val2;break;
-			case NL: return val1 >= val2;break;
-			case EQ: return val1 == val2;break;
-			case NEQ: return val1 != val2;break;
-			case '&': return val1 & val2;break;
-			case '^': return val1 ^ val2;break;
-			case '|': return val1 | val2;break;
-			case AND: return val1 && val2;break;
-			case OR: return val1 || val2;break;
-			case '!': return !val2;break;
-			case '~': return ~val2;break;
-			case DEREF: return vaddr_read(val2,1);break;
-			case NEG: return -val2;break;
-			default: assert(0);
-		}
-	}
-  return 0;
+
+/* evaluator */
+
+static word_t mem_word(paddr_t addr) {
+  return host_read(guest_to_host(addr), 4);
 }
 
-word_t expr(char *e, bool *success) {
-  *success=true;
-  if (!make_token(e)) {
-    *success = false;
-    return 0;
+static void add_reg_dep(ExprDeps *d, word_t *reg) {
+  int k;
+  for (k = 0; k < d->nr_reg; k ++) {
+    if (d->reg[k] == reg) return;
   }
+  if (d->nr_reg == EXPR_MAX_DEP) { d->overflow = true; return; }
+  d->reg[d->nr_reg] = reg;
+  d->reg_val[d->nr_reg ++] = *reg;
+}
 
-  /* TODO: Insert codes to evaluate the expression. */
-  for(int i = 0;i < nr_token;i++)
-  {
-    if(tokens[i].type == '*' && (i == 0 || isoperand(i-1)))
-		tokens[i].type = DEREF;
-	else if(tokens[i].type == '-' && (i == 0 || isoperand(i-1)))
-		tokens[i].type = NEG;
+static void add_mem_dep(ExprDeps *d, paddr_t addr) {
+  int k;
+  for (k = 0; k < d->nr_mem; k ++) {
+    if (d->mem[k] == addr) return;
   }
+  if (d->nr_mem == EXPR_MAX_DEP) { d->overflow = true; return; }
+  d->mem[d->nr_mem] = addr;
+  d->mem_val[d->nr_mem ++] = mem_word(addr);
+}
 
-  unsigned int ans = eval(0,nr_token-1,success);
-  //printf("%u\n",ans);
-  
-  return ans;
-}
\ No newline at end of file
+// If `deps` is not NULL, record what the evaluation reads, so that the
+// caller can tell whether the value may change with expr_deps_changed().
+word_t expr_eval(const ExprCode *c, bool *success, ExprDeps *deps) {
+  word_t stack[EXPR_MAX_INST];
+  word_t *top = stack - 1;
+  const ExprInst *i, *end = c->inst + c->nr_inst;
+  *success = true;
+  if (deps) { deps->nr_reg = deps->nr_mem = 0; deps->overflow = false; }
+
+  for (i = c->inst; i < end; i ++) {
+    word_t b;
+    switch (i->op) {
+      case OP_IMM: *(++ top) = i->imm; continue;
+      case OP_REG:
+        if (deps) add_reg_dep(deps, i->reg);
+        *(++ top) = *i->reg;
+        continue;
+      case OP_DEREF:
+        // do not touch devices, since reading them may have side effects
+        if (!in_pmem(*top) || !in_pmem(*top + 3)) { *success = false; return 0; }
+        if (deps) add_mem_dep(deps, *top);
+        *top = vaddr_read(*top, 4);
+        continue;
+      case OP_NEG:  *top = -*top; continue;
+      case OP_NOT:  *top = !*top; continue;
+      case OP_BNOT: *top = ~*top; continue;
+    }
+
+    b = *(top --);
+    switch (i->op) {
+      case OP_ADD: *top += b; break;
+      case OP_SUB: *top -= b; break;
+      case OP_MUL: *top *= b; break;
+      case OP_DIV: if (b == 0) { *success = false; return 0; } *top /= b; break;
+      case OP_REM: if (b == 0) { *success = false; return 0; } *top %= b; break;
+      case OP_SHL: *top = (b < sizeof(word_t) * 8 ? *top << b : 0); break;
+      case OP_SHR: *top = (b < sizeof(word_t) * 8 ? *top >> b : 0); break;
+      case OP_LT:  *top = *top <  b; break;
+      case OP_GT:  *top = *top >  b; break;
+      case OP_LE:  *top = *top <= b; break;
+      case OP_GE:  *top = *top >= b; break;
+      case OP_EQ:  *top = *top == b; break;
+      case OP_NE:  *top = *top != b; break;
+      case OP_AND: *top &= b; break;
+      case OP_XOR: *top ^= b; break;
+      case OP_OR:  *top |= b; break;
+      case OP_LAND: *top = *top && b; break;
+      case OP_LOR:  *top = *top || b; break;
+      default: panic("bad expression opcode %d", i->op);
+    }
+  }
+  assert(top == stack);
+  return *top;
+}
+
+// Nothing but registers and pmem is read by an expression, so its value
+// can only change after one of the recorded words changes. Comparing the
+// values also catches the writes which bypass the store path of the CPU,
+// such as DMA from devices.
+bool expr_deps_changed(const ExprDeps *d) {
+  if (unlikely(d->overflow)) return true;
+  int k;
+  for (k = 0; k < d->nr_reg; k ++) {
+    if (*d->reg[k] != d->reg_val[k]) return true;
+  }
+  for (k = 0; k < d->nr_mem; k ++) {
+    if (mem_word(d->mem[k]) != d->mem_val[k]) return true;
+  }
+  return false;
+}
+
+word_t expr(char *e, bool *success) {
+  static ExprCode c;
+  if (!expr_compile(e, &c)) {
+    *success = false;
+    return 0;
+  }
+  return expr_eval(&c, success, NULL);
+}
@@ -0,0 +1,405 @@
+#include <isa.h>
+#include <cpu/cpu.h>
+#include <memory/paddr.h>
+#include <memory/host.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <stddef.h>
+#include "sdb.h"
+
+// A stub of the GDB remote serial protocol, which lets GDB debug the guest
+// through a TCP socket. Software breakpoints are mapped onto the
+// breakpoint table, and write watchpoints onto watchpoints which read the
+// memory watched. The stub prefers no-ack mode, binary memory transfer
+// and large packets, so that bulk accesses take few round trips.
+
+#define PACKET_SIZE 0x20000
+// the number of instructions executed before checking for a ctrl-c from GDB
+#define RUN_CHUNK 65536
+
+// GDB sees the general purpose registers followed by pc
+#define NR_GDB_REG 33
+static_assert(offsetof(CPU_state, pc) == 32 * sizeof(word_t), "pc should follow the GPRs");
+
+extern uint64_t g_nr_guest_instr;
+
+static int fd = -1;
+static bool noack = false;
+static char in[PACKET_SIZE + 16];
+static char out[2 * PACKET_SIZE + 16];
+static uint8_t mem_buf[PACKET_SIZE];
+
+/* connection */
+
+static uint8_t rbuf[4096];
+static int rbuf_len = 0, rbuf_pos = 0;
+
+static int get_byte() {
+  if (rbuf_pos == rbuf_len) {
+    rbuf_pos = rbuf_len = 0;
+    int n = read(fd, rbuf, sizeof(rbuf));
+    if (n <= 0) return -1;
+    rbuf_len = n;
+  }
+  return rbuf[rbuf_pos ++];
+}
+
+static void put_all(const char *buf, int len) {
+  while (len > 0) {
+    int ret = write(fd, buf, len);
+    if (ret <= 0) return;
+    buf += ret;
+    len -= ret;
+  }
+}
+
+static const char hexchars[] = "0123456789abcdef";
+
+static int hex(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// return the length of the packet in `in`, or -1 if the connection is closed
+static int recv_packet() {
+  while (true) {
+    int c;
+    while ((c = get_byte()) != '$') {
+      if (c == -1) return -1;
+    }
+    int len = 0;
+    uint8_t sum = 0;
+    while ((c = get_byte()) != '#') {
+      if (c == -1) return -1;
+      if (len < sizeof(in) - 1) in[len ++] = c;
+      sum += c;
+    }
+    int c1 = get_byte(), c2 = get_byte();
+    if (c2 == -1) return -1;
+    in[len] = '\0';
+    if (noack) return len;
+    if (((hex(c1) << 4) | hex(c2)) == sum) {
+      put_all("+", 1);
+      return len;
+    }
+    put_all("-", 1);
+  }
+}
+
+static void send_packet(const char *data, int len) {
+  static char pkt[sizeof(out) + 4];
+  uint8_t sum = 0;
+  int i;
+  pkt[0] = '$';
+  for (i = 0; i < len; i ++) {
+    pkt[i + 1] = data[i];
+    sum += data[i];
+  }
+  pkt[len + 1] = '#';
+  pkt[len + 2] = hexchars[sum >> 4];
+  pkt[len + 3] = hexchars[sum & 0xf];
+  while (true) {
+    put_all(pkt, len + 4);
+    if (noack) return;
+    int c = get_byte();
+    if (c == '+' || c == -1) return;
+  }
+}
+
+static void send_str(const char *s) {
+  send_packet(s, strlen(s));
+}
+
+/* helpers */
+
+static char* put_hex(char *p, const uint8_t *buf, int len) {
+  int i;
+  for (i = 0; i < len; i ++) {
+    *p ++ = hexchars[buf[i] >> 4];
+    *p ++ = hexchars[buf[i] & 0xf];
+  }
+  return p;
+}
+
+static int get_hex(const char *p, uint8_t *buf, int len) {
+  int i;
+  for (i = 0; i < len; i ++) {
+    int h = hex(p[2 * i]), l = hex(p[2 * i + 1]);
+    if (h < 0 || l < 0) return i;
+    buf[i] = (h << 4) | l;
+  }
+  return len;
+}
+
+static inline bool need_escape(uint8_t c) {
+  return c == '#' || c == '$' || c == '}' || c == '*';
+}
+
+static word_t* gdb_reg(unsigned n) {
+  return (n < NR_GDB_REG ? (word_t *)&cpu + n : NULL);
+}
+
+// only pmem is accessible, since accessing devices has side effects
+static bool mem_ok(paddr_t addr, word_t len) {
+  return len <= PACKET_SIZE && (len == 0 || (in_pmem(addr) && in_pmem(addr + len - 1)));
+}
+
+static void mem_write(paddr_t addr, const uint8_t *buf, int len) {
+  // go through paddr_write() to keep the writes tracked
+  int i;
+  for (i = 0; i < len; i ++) paddr_write(addr + i, 1, buf[i]);
+}
+
+/* stop reasons */
+
+// Only the interrupt byte (0x03) is consumed. Other bytes are kept in
+// `rbuf` for recv_packet().
+static bool interrupted() {
+  struct pollfd pfd = { .fd = fd, .events = POLLIN };
+  if (rbuf_len < sizeof(rbuf) && poll(&pfd, 1, 0) > 0) {
+    memmove(rbuf, rbuf + rbuf_pos, rbuf_len - rbuf_pos);
+    rbuf_len -= rbuf_pos;
+    rbuf_pos = 0;
+    int n = read(fd, rbuf + rbuf_len, sizeof(rbuf) - rbuf_len);
+    if (n <= 0) return true; // GDB goes away
+    rbuf_len += n;
+  }
+  uint8_t *p = memchr(rbuf + rbuf_pos, 0x03, rbuf_len - rbuf_pos);
+  if (p == NULL) return false;
+  memmove(p, p + 1, rbuf + rbuf_len - p - 1);
+  rbuf_len --;
+  return true;
+}
+
+#define NR_GDB_WP 32
+static struct { paddr_t addr; int len; int NO; } gdb_wp[NR_GDB_WP];
+static int nr_gdb_wp = 0;
+
+static void stop_reply(bool step) {
+  char buf[64];
+  switch (nemu_state.state) {
+    case NEMU_END:   snprintf(buf, sizeof(buf), "W%02x", nemu_state.halt_ret & 0xff); break;
+    case NEMU_ABORT: snprintf(buf, sizeof(buf), "X06"); break;
+    default: {
+      int i, NO = MUXDEF(CONFIG_WATCHPOINT, wp_last_changed(), -1);
+      for (i = 0; i < nr_gdb_wp; i ++) {
+        if (gdb_wp[i].NO == NO) {
+          snprintf(buf, sizeof(buf), "T05watch:%lx;", (uint64_t)gdb_wp[i].addr);
+          send_str(buf);
+          return;
+        }
+      }
+      snprintf(buf, sizeof(buf), (step ? "S05" : "T05swbreak:;"));
+    }
+  }
+  send_str(buf);
+}
+
+static void run(bool step) {
+  if (step) {
+    cpu_exec(1);
+  } else {
+    while (true) {
+      uint64_t start = g_nr_guest_instr;
+      cpu_exec(RUN_CHUNK);
+      if (nemu_state.state != NEMU_STOP || g_nr_guest_instr - start < RUN_CHUNK) break;
+      if (interrupted()) { send_str("T02"); return; }
+    }
+  }
+  stop_reply(step);
+}
+
+/* breakpoints and watchpoints */
+
+// Without a Z packet for watchpoints, GDB falls back to software
+// watchpoints by single-stepping. Its fallback for breakpoints writes a
+// breakpoint instruction into the guest, which NEMU takes as nemu_trap,
+// so breakpoints are always supported.
+static bool point_supported(int type) {
+  return type == 0 || type == 1 || (type == 2 && MUXDEF(CONFIG_WATCHPOINT, true, false));
+}
+
+static bool insert_point(int type, paddr_t addr, int len) {
+  char buf[128];
+  bool success = false;
+  switch (type) {
+    case 0: case 1:
+      snprintf(buf, sizeof(buf), "0x%lx", (uint64_t)addr);
+      add_bp(buf, &success);
+      return success;
+    case 2:
+      if (len > 8 || nr_gdb_wp == NR_GDB_WP) return false;
+      if (len <= 4) snprintf(buf, sizeof(buf), "*0x%lx & 0x%lx", (uint64_t)addr, (1ul << (len * 8)) - 1);
+      else snprintf(buf, sizeof(buf), "*0x%lx | *0x%lx << 32 & 0x%lx",
+          (uint64_t)addr, (uint64_t)addr + 4, (len == 8 ? -1ul : (1ul << (len * 8)) - 1));
+      int NO = add_wp(buf, &success);
+      if (success) gdb_wp[nr_gdb_wp ++] = (typeof(gdb_wp[0])){ .addr = addr, .len = len, .NO = NO };
+      return success;
+    default: return false;
+  }
+}
+
+static bool remove_point(int type, paddr_t addr, int len) {
+  int i;
+  switch (type) {
+    case 0: case 1:
+      return delete_bp_at(addr);
+    case 2:
+      for (i = 0; i < nr_gdb_wp; i ++) {
+        if (gdb_wp[i].addr == addr && gdb_wp[i].len == len) {
+          delete_wp(gdb_wp[i].NO);
+          gdb_wp[i] = gdb_wp[-- nr_gdb_wp];
+          return true;
+        }
+      }
+      return false;
+    default: return false;
+  }
+}
+
+/* packets */
+
+// return false when GDB goes away
+static bool handle_packet(int len) {
+  char *p = in + 1;
+  uint64_t addr, n;
+  int i;
+  switch (in[0]) {
+    case '?': send_str("S05"); break;
+
+    case 'g': {
+      char *o = out;
+      for (i = 0; i < NR_GDB_REG; i ++) o = put_hex(o, (uint8_t *)gdb_reg(i), sizeof(word_t));
+      send_packet(out, o - out);
+      break;
+    }
+    case 'G':
+      if (len - 1 < NR_GDB_REG * sizeof(word_t) * 2) { send_str("E01"); break; }
+      for (i = 0; i < NR_GDB_REG; i ++) get_hex(p + i * sizeof(word_t) * 2, (uint8_t *)gdb_reg(i), sizeof(word_t));
+      *gdb_reg(0) = 0;
+      send_str("OK");
+      break;
+    case 'p': {
+      word_t *r = gdb_reg(strtoul(p, NULL, 16));
+      if (r == NULL) { memset(out, 'x', sizeof(word_t) * 2); send_packet(out, sizeof(word_t) * 2); }
+      else send_packet(out, put_hex(out, (uint8_t *)r, sizeof(word_t)) - out);
+      break;
+    }
+    case 'P': {
+      char *eq;
+      word_t *r = gdb_reg(strtoul(p, &eq, 16));
+      if (r == NULL || *eq != '=') { send_str("E01"); break; }
+      get_hex(eq + 1, (uint8_t *)r, sizeof(word_t));
+      *gdb_reg(0) = 0;
+      send_str("OK");
+      break;
+    }
+
+    case 'm': case 'x':
+      if (sscanf(p, "%lx,%lx", &addr, &n) != 2 || !mem_ok(addr, n)) { send_str("E14"); break; }
+      if (in[0] == 'm') {
+        send_packet(out, put_hex(out, guest_to_host(addr), n) - out);
+      } else {
+        char *o = out;
+        uint8_t *src = (n == 0 ? NULL : guest_to_host(addr));
+        *o ++ = 'b';
+        for (i = 0; i < n; i ++) {
+          if (need_escape(src[i])) { *o ++ = '}'; *o ++ = src[i] ^ 0x20; }
+          else *o ++ = src[i];
+        }
+        send_packet(out, o - out);
+      }
+      break;
+    case 'M': case 'X': {
+      char *colon = strchr(p, ':');
+      if (colon == NULL || sscanf(p, "%lx,%lx", &addr, &n) != 2 || !mem_ok(addr, n)) { send_str("E14"); break; }
+      colon ++;
+      if (in[0] == 'M') {
+        if (get_hex(colon, mem_buf, n) != n) { send_str("E01"); break; }
+      } else {
+        char *end = in + len;
+        for (i = 0; i < n && colon < end; i ++) {
+          uint8_t c = *colon ++;
+          mem_buf[i] = (c == '}' ? (*colon ++ ^ 0x20) : c);
+        }
+        if (i != n) { send_str("E01"); break; }
+      }
+      mem_write(addr, mem_buf, n);
+      send_str("OK");
+      break;
+    }
+
+    case 'c': case 'C': run(false); break;
+    case 's': case 'S': run(true); break;
+
+    case 'Z': case 'z': {
+      int type, kind;
+      if (sscanf(p, "%d,%lx,%x", &type, &addr, &kind) != 3) { send_str("E01"); break; }
+      if (!point_supported(type)) { send_str(""); break; }
+      bool ok = (in[0] == 'Z' ? insert_point(type, addr, kind) : remove_point(type, addr, kind));
+      send_str(ok ? "OK" : "E01");
+      break;
+    }
+
+    case 'v':
+      if (strcmp(in, "vCont?") == 0) send_str("vCont;c;C;s;S");
+      else if (strncmp(in, "vCont;", 6) == 0) run(in[6] == 's' || in[6] == 'S');
+      else if (strncmp(in, "vKill", 5) == 0) { send_str("OK"); return false; }
+      else send_str("");
+      break;
+
+    case 'q':
+      if (strncmp(in, "qSupported", 10) == 0) {
+        snprintf(out, sizeof(out), "PacketSize=%x;QStartNoAckMode+;swbreak+;vContSupported+", PACKET_SIZE);
+        send_str(out);
+      }
+      else if (strcmp(in, "qAttached") == 0) send_str("1");
+      else if (strcmp(in, "qC") == 0) send_str("QC1");
+      else if (strcmp(in, "qfThreadInfo") == 0) send_str("m1");
+      else if (strcmp(in, "qsThreadInfo") == 0) send_str("l");
+      else send_str("");
+      break;
+    case 'Q':
+      if (strcmp(in, "QStartNoAckMode") == 0) { send_str("OK"); noack = true; }
+      else send_str("");
+      break;
+    case 'H': case 'T': send_str("OK"); break;
+    case 'D': send_str("OK"); return false;
+    case 'k': return false;
+    default: send_str(""); break;
+  }
+  return true;
+}
+
+void gdb_mainloop(int port) {
+  int lfd = socket(AF_INET, SOCK_STREAM, 0);
+  assert(lfd >= 0);
+  int on = 1;
+  setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  struct sockaddr_in sa = { .sin_family = AF_INET, .sin_port = htons(port),
+    .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+  Assert(bind(lfd, (struct sockaddr *)&sa, sizeof(sa)) == 0, "Can not bind to port %d", port);
+  assert(listen(lfd, 1) == 0);
+  Log("Waiting for GDB at 127.0.0.1:%d", port);
+
+  fd = accept(lfd, NULL, NULL);
+  assert(fd >= 0);
+  close(lfd);
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  Log("GDB connected");
+
+  int len;
+  while ((len = recv_packet()) >= 0) {
+    if (len == 0) { send_str(""); continue; }
+    if (!handle_packet(len)) break;
+  }
+  close(fd);
+  Log("GDB disconnected");
+  if (nemu_state.state == NEMU_RUNNING || nemu_state.state == NEMU_STOP) nemu_state.state = NEMU_QUIT;
+}
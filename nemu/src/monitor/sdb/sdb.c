@@ -1,14 +1,18 @@
 #include <isa.h>
 #include <cpu/cpu.h>
+#include <cpu/difftest.h>
+#include <cpu/reverse.h>
+#include <cpu/stat.h>
 #include <readline/readline.h>
 #include <readline/history.h>
 #include <memory/paddr.h>
 #include "sdb.h"
 
 static int is_batch_mode = false;
+static int gdb_port = 0;
 
-void init_regex();
 void init_wp_pool();
+void init_bp_pool();
 
 /* We use the `readline' library to provide more flexibility to read from stdin. */
 static char* rl_gets() {
@@ -52,14 +56,15 @@ static int cmd_si(char *args) {
 
 static int cmd_p(char *args)
 {
+  if (args == NULL) return 0;
   bool flag=true;
-  int val = expr(args,&flag);
-  printf("%d\n",val);
+  word_t val = expr(args,&flag);
   if(!flag)
   {
     printf("Wrong format!\n");
-    return -1;
+    return 0;
   }
+  printf("%lu\t" FMT_WORD "\n", (uint64_t)val, val);
   return 0;
 }
 
@@ -75,7 +80,14 @@ static int cmd_info(char *args) {
   }else if(strcmp(op, "w") == 0){
       /* print the information of watch points */
       wp_display();
+    }else if(strcmp(op, "b") == 0){
+      bp_display();
+    }
+#ifdef CONFIG_INSTR_STAT
+    else if(strcmp(op, "stat") == 0){
+      stat_dump(stdout);
     }
+#endif
   return 0;
 }
 
@@ -85,20 +97,20 @@ static int cmd_x(char *args) {
     return 0;
   }
   int num1 = atoi(s_num1);
-  char* s_num2 = strtok(NULL, " ");
+  // 剩下的部分是一个表达式, 可以使用寄存器和符号
+  char* s_num2 = strtok(NULL, "");
   if (s_num2 == NULL) {
     return 0;
   }
-  if (strlen(s_num2) <= 2) {
-    Assert(0, "x的第二个参数必须以0x开头,怎么会长度<=2呢?");
+  bool success;
+  paddr_t addr = expr(s_num2, &success);
+  if (!success) {
+    printf("Wrong format!\n");
+    return 0;
   }
-  // 因为开头有一个0x, 我们需要去掉它, 不然解析会出错
-  // BUG here: atoi默认是十进制, 但是这里应该是十六进制
-  // paddr_t addr = atoi(s_num2+2);
-  paddr_t addr = (paddr_t)strtol(s_num2+2, NULL, 16);
   // 开始扫描
   printf("%s\t\t%-34s%-32s\n", "addr", "16进制", "10进制");
-  printf("%s:\t", s_num2);
+  printf("0x%x:\t", addr);
   for (int i = 1; i <= num1<<2; i++) {
     // 因为这个是一个字节数组, 所以我们需要四个为一组进行扫描
     if (i%4 != 0) {
@@ -121,6 +133,7 @@ static int cmd_x(char *args) {
 }
 
 static int cmd_w(char* args) {
+  if (args == NULL) return 0;
   bool success;
   add_wp(args, &success);
   if (!success) printf("Unvalid expression\n");
@@ -134,6 +147,21 @@ static int cmd_d(char* args) {
   return 0;
 }
 
+static int cmd_b(char* args) {
+  if (args == NULL) return 0;
+  bool success;
+  add_bp(args, &success);
+  if (!success) printf("Unvalid breakpoint\n");
+  return 0;
+}
+
+static int cmd_bd(char* args) {
+  int n;
+  if (args == NULL || sscanf(args, "%d", &n) != 1) return 0;
+  if (!delete_bp(n)) printf("Breakpoint %d does not exist\n", n);
+  return 0;
+}
+
 static int cmd_exprtest(char* args) {
 
   FILE* input = fopen("tools/gen-expr/input", "r");
@@ -152,8 +180,8 @@ static int cmd_exprtest(char* args) {
     //printf("%s\n%s", t_res_s, t_expr);
 
     word_t res = expr(t_expr, &success);
-    word_t t_res;
-    sscanf(t_res_s, "%lu", &t_res);
+    // gen-expr computes the result in the width of word_t
+    word_t t_res = strtoull(t_res_s, NULL, 10);
 
     if (success && (res == t_res)) {
       printf("%d times: Correct\n", try_count);
@@ -161,13 +189,36 @@ static int cmd_exprtest(char* args) {
     else {
       error_count++;
       printf("%d times: Error\n", try_count);
-      printf("Expression:%s\n given_result:%lu\tnemu_result:%lu\n", t_expr, t_res, res);
+      printf("Expression:%s\n given_result:%lu\tnemu_result:%lu\n", t_expr, (uint64_t)t_res, (uint64_t)res);
     }
   }
   printf("Total: %d errors\n", error_count);
   return 0;
 }
 
+#ifdef CONFIG_REVERSE
+static int cmd_rsi(char *args) {
+  char* s_num = strtok(NULL, " ");
+  reverse_step(s_num == NULL ? 1 : strtoull(s_num, NULL, 10));
+  return 0;
+}
+
+static int cmd_rc(char *args) {
+  reverse_continue();
+  return 0;
+}
+#endif
+
+static int cmd_detach(char *args) {
+  difftest_detach();
+  return 0;
+}
+
+static int cmd_attach(char *args) {
+  difftest_attach();
+  return 0;
+}
+
 static int cmd_help(char *args);
 
 static struct {
@@ -185,7 +236,15 @@ static struct {
   {"p", "p Expr", cmd_p},
   {"w", "Set a watchpoint to supervise the value of an expression", cmd_w},
   {"d", "Delete watchpoint N", cmd_d},
+  {"b", "b ADDR [if EXPR], stop before the instruction at ADDR if EXPR is true", cmd_b},
+  {"bd", "Delete breakpoint N", cmd_bd},
   {"exprtest", "To test the correctness of command p", cmd_exprtest},
+#ifdef CONFIG_REVERSE
+  {"rsi", "Step N instructions backwards", cmd_rsi},
+  {"rc", "Continue backwards to the last hit of a watchpoint or breakpoint", cmd_rc},
+#endif
+  {"detach", "Exit the DiffTest mode", cmd_detach},
+  {"attach", "Enter the DiffTest mode, only the pages written since detach are copied to REF", cmd_attach},
 
 };
 
@@ -218,7 +277,16 @@ void sdb_set_batch_mode() {
   is_batch_mode = true;
 }
 
+void sdb_set_gdb_port(int port) {
+  gdb_port = port;
+}
+
 void sdb_mainloop() {
+  if (gdb_port != 0) {
+    gdb_mainloop(gdb_port);
+    return;
+  }
+
   if (is_batch_mode) {
     cmd_c(NULL);
     return;
@@ -258,9 +326,9 @@ void sdb_mainloop() {
 }
 
 void init_sdb() {
-  /* Compile the regular expressions. */
-  init_regex();
-
   /* Initialize the watchpoint pool. */
   init_wp_pool();
+
+  /* Initialize the breakpoint pool. */
+  init_bp_pool();
 }
@@ -3,12 +3,57 @@
 
 #include <common.h>
 
+/* expression */
+
+#define EXPR_MAX_INST 64
+
+typedef struct {
+  int op;
+  union {
+    word_t imm;
+    word_t *reg;
+  };
+} ExprInst;
+
+// an expression compiled into a stack bytecode
+typedef struct {
+  int nr_inst;
+  ExprInst inst[EXPR_MAX_INST];
+} ExprCode;
+
+// the registers and memory words read by an evaluation, with their values
+#define EXPR_MAX_DEP 16
+
+typedef struct {
+  int nr_reg, nr_mem;
+  bool overflow; // too many to record, treated as always changed
+  word_t *reg[EXPR_MAX_DEP];
+  word_t reg_val[EXPR_MAX_DEP];
+  paddr_t mem[EXPR_MAX_DEP];
+  word_t mem_val[EXPR_MAX_DEP];
+} ExprDeps;
+
+bool expr_compile(char *e, ExprCode *code);
+word_t expr_eval(const ExprCode *code, bool *success, ExprDeps *deps);
+bool expr_deps_changed(const ExprDeps *deps);
 word_t expr(char *e, bool *success);
 
 /* watcpoint */
 
-void add_wp(char* expr_c, bool* success);
+int add_wp(char* expr_c, bool* success);
 bool delete_wp(int NO);
 void wp_display();
+int wp_last_changed();
+
+/* breakpoint */
+
+void add_bp(char *args, bool *success);
+bool delete_bp(int NO);
+bool delete_bp_at(vaddr_t addr);
+void bp_display();
+
+/* gdb */
+
+void gdb_mainloop(int port);
 
 #endif
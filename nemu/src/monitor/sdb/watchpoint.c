@@ -9,6 +9,8 @@ typedef struct watchpoint {
   /* TODO: Add more members if necessary */
 
   char expr[64];  // the expression watched
+  ExprCode code;  // the expression compiled
+  ExprDeps deps;  // what the last evaluation read
   word_t last_val;// last value of the expression
 
 } WP;
@@ -34,15 +36,22 @@ WP* new_wp(char* expr_c) {
   assert(free_);
   WP* new = free_;
   free_ = free_->next;
-  strcpy(new->expr, expr_c);
+  strncpy(new->expr, expr_c, sizeof(new->expr) - 1);
+  new->expr[sizeof(new->expr) - 1] = '\0';
   return new;
 }
 
-void add_wp(char* expr_c, bool* success) {
+// return the number of the new watchpoint
+int add_wp(char* expr_c, bool* success) {
+  static ExprCode code;
+  if (!expr_compile(expr_c, &code)) { *success = false; return -1; }
+  if (!free_) { printf("Too many watchpoints\n"); *success = false; return -1; }
   WP* new = new_wp(expr_c);
+  new->code = code;
   new->next = head;
-  new->last_val = expr(expr_c, success);
+  new->last_val = expr_eval(&new->code, success, &new->deps);
   head = new;
+  return new->NO;
 }
 
 void free_wp(WP *wp) {
@@ -52,6 +61,7 @@ void free_wp(WP *wp) {
 
 bool delete_wp(int NO) {
   WP* wp_NO = head;
+  if (!wp_NO) return false;
   if (wp_NO->NO == NO) {
     head = wp_NO->next;
     free_wp(wp_NO);
@@ -81,18 +91,39 @@ void wp_display() {
   }
 }
 
-bool wp_update_display_changed() {
+// the first watchpoint changed in the last wp_update(), or -1
+static int last_changed = -1;
+
+// A watchpoint is evaluated again only if some register or memory word
+// read by its last evaluation has changed, which is much cheaper than
+// running the expression after every instruction.
+bool wp_update(bool display) {
   WP* temp = head;
   bool flag = false;
+  last_changed = -1;
   bool success;     // not used
   while(temp != NULL){
-    word_t new_val = expr(temp->expr, &success);
+    if (likely(!expr_deps_changed(&temp->deps))) { temp = temp->next; continue; }
+    word_t new_val = expr_eval(&temp->code, &success, &temp->deps);
     if (temp->last_val != new_val) {
-      if(!flag) {flag = true; printf("Watchpoint value changed:\n");}
-      printf("Watchpoint %2d: %-16s new:%-10lu(0x%08lx)      old:%-10lu(0x%08lx)\n", temp->NO, temp->expr, new_val, new_val, temp->last_val, temp->last_val);
+      if (display) {
+        if(!flag) printf("Watchpoint value changed:\n");
+        printf("Watchpoint %2d: %-16s new:%-10lu(0x%08lx)      old:%-10lu(0x%08lx)\n", temp->NO, temp->expr, new_val, new_val, temp->last_val, temp->last_val);
+      }
+      if (!flag) last_changed = temp->NO;
+      flag = true;
       temp->last_val = new_val;
     }
     temp = temp->next;
   }
   if (flag) return true; else return false;
-}
\ No newline at end of file
+}
+
+bool wp_update_display_changed() {
+  return wp_update(true);
+}
+
+// the first watchpoint changed by the last instruction, or -1
+int wp_last_changed() {
+  return last_changed;
+}
@@ -0,0 +1,138 @@
+#include <common.h>
+
+#ifndef CONFIG_TARGET_AM
+#include <elf.h>
+
+// Symbols from the .symtab of the guest ELF. Functions are kept in an
+// array sorted by address for address->function lookups, and all named
+// symbols are put into an open addressing hash table for name->address
+// lookups.
+
+typedef struct {
+  vaddr_t addr;
+  vaddr_t size;
+  const char *name;
+} Symbol;
+
+static char *strtab = NULL;
+static Symbol *func = NULL;
+static int nr_func = 0;
+static Symbol *hash = NULL;
+static uint32_t hash_mask = 0;
+
+static uint32_t hash_str(const char *s) {
+  uint32_t h = 2166136261u; // FNV-1a
+  for (; *s; s ++) h = (h ^ (uint8_t)*s) * 16777619u;
+  return h;
+}
+
+static void hash_insert(const char *name, vaddr_t addr, vaddr_t size, bool global) {
+  uint32_t i = hash_str(name) & hash_mask;
+  while (hash[i].name != NULL) {
+    if (strcmp(hash[i].name, name) == 0) {
+      // a global symbol hides the local ones with the same name
+      if (global) hash[i] = (Symbol){ .addr = addr, .size = size, .name = name };
+      return;
+    }
+    i = (i + 1) & hash_mask;
+  }
+  hash[i] = (Symbol){ .addr = addr, .size = size, .name = name };
+}
+
+static int cmp_addr(const void *a, const void *b) {
+  vaddr_t x = ((Symbol *)a)->addr, y = ((Symbol *)b)->addr;
+  return (x > y) - (x < y);
+}
+
+#define LOAD_SYMTAB(Ehdr, Shdr, Sym, ST_TYPE, ST_BIND) do { \
+  Ehdr *eh = (void *)buf; \
+  Assert(eh->e_shoff + (size_t)eh->e_shnum * sizeof(Shdr) <= size, "bad section headers in '%s'", file); \
+  Shdr *sh = (void *)(buf + eh->e_shoff); \
+  int i; \
+  for (i = 0; i < eh->e_shnum && sh[i].sh_type != SHT_SYMTAB; i ++); \
+  if (i == eh->e_shnum) { Log("No symbol table in '%s'", file); free(buf); return; } \
+  Shdr *str_sh = &sh[sh[i].sh_link]; \
+  strtab = malloc(str_sh->sh_size + 1); \
+  assert(strtab); \
+  memcpy(strtab, buf + str_sh->sh_offset, str_sh->sh_size); \
+  strtab[str_sh->sh_size] = '\0'; \
+  Sym *sym = (void *)(buf + sh[i].sh_offset); \
+  int nr_sym = sh[i].sh_size / sizeof(Sym); \
+  uint32_t nr_slot = 16; \
+  while (nr_slot < 2 * nr_sym) nr_slot *= 2; \
+  hash = calloc(nr_slot, sizeof(Symbol)); \
+  func = malloc(sizeof(Symbol) * nr_sym); \
+  assert(hash && func); \
+  hash_mask = nr_slot - 1; \
+  int j; \
+  for (j = 0; j < nr_sym; j ++) { \
+    int type = ST_TYPE(sym[j].st_info); \
+    const char *name = strtab + sym[j].st_name; \
+    if (sym[j].st_name >= str_sh->sh_size || name[0] == '\0') continue; \
+    if (type != STT_FUNC && type != STT_OBJECT && type != STT_NOTYPE) continue; \
+    if (sym[j].st_shndx == SHN_UNDEF) continue; \
+    hash_insert(name, sym[j].st_value, sym[j].st_size, ST_BIND(sym[j].st_info) == STB_GLOBAL); \
+    if (type == STT_FUNC) { \
+      func[nr_func ++] = (Symbol){ .addr = sym[j].st_value, .size = sym[j].st_size, .name = name }; \
+    } \
+  } \
+} while (0)
+
+void init_symtab(const char *file) {
+  if (file == NULL) return;
+  FILE *fp = fopen(file, "rb");
+  Assert(fp, "Can not open '%s'", file);
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  uint8_t *buf = malloc(size);
+  assert(buf);
+  int ret = fread(buf, size, 1, fp);
+  assert(ret == 1);
+  fclose(fp);
+
+  Assert(size >= EI_NIDENT && memcmp(buf, ELFMAG, SELFMAG) == 0, "'%s' is not an ELF file", file);
+  if (buf[EI_CLASS] == ELFCLASS64) {
+    LOAD_SYMTAB(Elf64_Ehdr, Elf64_Shdr, Elf64_Sym, ELF64_ST_TYPE, ELF64_ST_BIND);
+  } else {
+    LOAD_SYMTAB(Elf32_Ehdr, Elf32_Shdr, Elf32_Sym, ELF32_ST_TYPE, ELF32_ST_BIND);
+  }
+  free(buf);
+
+  qsort(func, nr_func, sizeof(Symbol), cmp_addr);
+  Log("Load %d functions from the symbol table of %s", nr_func, file);
+}
+
+bool symtab_lookup(const char *name, vaddr_t *addr) {
+  if (hash == NULL) return false;
+  uint32_t i = hash_str(name) & hash_mask;
+  while (hash[i].name != NULL) {
+    if (strcmp(hash[i].name, name) == 0) {
+      *addr = hash[i].addr;
+      return true;
+    }
+    i = (i + 1) & hash_mask;
+  }
+  return false;
+}
+
+// return the name of the function containing `addr`, or NULL
+const char* symtab_func(vaddr_t addr, vaddr_t *start) {
+  // consecutive lookups usually hit the same function
+  static const Symbol *last = NULL;
+  const Symbol *f = last;
+  if (f == NULL || addr < f->addr || addr - f->addr >= f->size) {
+    int l = 0, r = nr_func - 1;
+    f = NULL;
+    while (l <= r) {
+      int m = (l + r) / 2;
+      if (func[m].addr <= addr) { f = &func[m]; l = m + 1; }
+      else r = m - 1;
+    }
+    if (f == NULL || (addr - f->addr >= f->size && f->size != 0)) return NULL;
+    last = f;
+  }
+  if (start) *start = f->addr;
+  return f->name;
+}
+#endif
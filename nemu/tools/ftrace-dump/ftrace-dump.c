@@ -0,0 +1,268 @@
+// Read the function trace written by NEMU with --ftrace.
+//   ftrace-dump [-e ELF] TRACE      print the calls and returns with indentation
+//   ftrace-dump [-e ELF] -t TRACE   print the call tree, with the number of
+//                                   instructions executed in each function
+//                                   including (incl) and excluding (excl)
+//                                   the functions it calls
+// See include/cpu/ftrace.h for the format.
+
+#include <assert.h>
+#include <elf.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define FTRACE_MAGIC 0x31525446554d454eull // "NEMUFTR1"
+
+enum { FTRACE_CALL, FTRACE_RET, FTRACE_TAIL, FTRACE_END };
+
+typedef struct {
+  uint64_t instr;
+  uint64_t from;
+  uint64_t to;
+} Record;
+
+/* symbols */
+
+typedef struct {
+  uint64_t addr, size;
+  const char *name;
+} Func;
+
+static Func *func = NULL;
+static int nr_func = 0;
+
+static int cmp_addr(const void *a, const void *b) {
+  uint64_t x = ((Func *)a)->addr, y = ((Func *)b)->addr;
+  return (x > y) - (x < y);
+}
+
+#define LOAD_SYMTAB(Ehdr, Shdr, Sym, ST_TYPE) do { \
+  Ehdr *eh = (void *)buf; \
+  Shdr *sh = (void *)(buf + eh->e_shoff); \
+  int i, j; \
+  for (i = 0; i < eh->e_shnum && sh[i].sh_type != SHT_SYMTAB; i ++); \
+  if (i == eh->e_shnum) break; \
+  char *strtab = (char *)buf + sh[sh[i].sh_link].sh_offset; \
+  Sym *sym = (void *)(buf + sh[i].sh_offset); \
+  int nr_sym = sh[i].sh_size / sizeof(Sym); \
+  func = malloc(sizeof(Func) * nr_sym); \
+  assert(func); \
+  for (j = 0; j < nr_sym; j ++) { \
+    if (ST_TYPE(sym[j].st_info) != STT_FUNC || sym[j].st_shndx == SHN_UNDEF) continue; \
+    func[nr_func ++] = (Func){ .addr = sym[j].st_value, .size = sym[j].st_size, \
+      .name = strtab + sym[j].st_name }; \
+  } \
+} while (0)
+
+static void load_elf(const char *file) {
+  FILE *fp = fopen(file, "rb");
+  if (fp == NULL) { perror(file); exit(1); }
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  uint8_t *buf = malloc(size); // kept for the names
+  assert(buf);
+  int ret = fread(buf, size, 1, fp);
+  assert(ret == 1);
+  fclose(fp);
+
+  if (size < EI_NIDENT || memcmp(buf, ELFMAG, SELFMAG) != 0) {
+    fprintf(stderr, "%s is not an ELF file\n", file);
+    exit(1);
+  }
+  if (buf[EI_CLASS] == ELFCLASS64) LOAD_SYMTAB(Elf64_Ehdr, Elf64_Shdr, Elf64_Sym, ELF64_ST_TYPE);
+  else LOAD_SYMTAB(Elf32_Ehdr, Elf32_Shdr, Elf32_Sym, ELF32_ST_TYPE);
+  qsort(func, nr_func, sizeof(Func), cmp_addr);
+}
+
+static Func* find_func(uint64_t addr) {
+  int l = 0, r = nr_func - 1;
+  Func *f = NULL;
+  while (l <= r) {
+    int m = (l + r) / 2;
+    if (func[m].addr <= addr) { f = &func[m]; l = m + 1; }
+    else r = m - 1;
+  }
+  if (f == NULL || (addr - f->addr >= f->size && f->size != 0)) return NULL;
+  return f;
+}
+
+// "name+0xoff", or the address when there is no symbol
+static const char* addr_str(uint64_t addr) {
+  static char buf[4][128];
+  static int k = 0;
+  char *p = buf[k ++ % 4];
+  Func *f = find_func(addr);
+  if (f == NULL) snprintf(p, 128, "0x%lx", addr);
+  else if (addr == f->addr) snprintf(p, 128, "%s", f->name);
+  else snprintf(p, 128, "%s+0x%lx", f->name, addr - f->addr);
+  return p;
+}
+
+// the start of the function containing `addr'
+static uint64_t func_start(uint64_t addr) {
+  Func *f = find_func(addr);
+  return (f ? f->addr : addr);
+}
+
+/* call tree */
+
+typedef struct Node {
+  uint64_t addr;
+  uint64_t calls, incl, excl;
+  struct Node *parent, *child, *next;
+} Node;
+
+typedef struct {
+  Node *node;
+  uint64_t start; // instruction count when entered
+  uint64_t ret;   // return address
+} Frame;
+
+static Node root = {};
+static Frame *stack = NULL;
+static int depth = 0, max_depth = 0;
+
+static Node* child_of(Node *parent, uint64_t addr) {
+  Node *n;
+  for (n = parent->child; n != NULL; n = n->next) {
+    if (n->addr == addr) return n;
+  }
+  n = calloc(1, sizeof(Node));
+  assert(n);
+  n->addr = addr;
+  n->parent = parent;
+  n->next = parent->child;
+  parent->child = n;
+  return n;
+}
+
+static void push(Node *parent, uint64_t addr, uint64_t instr, uint64_t ret) {
+  if (depth == max_depth) {
+    max_depth = (max_depth == 0 ? 64 : max_depth * 2);
+    stack = realloc(stack, sizeof(Frame) * max_depth);
+    assert(stack);
+  }
+  Node *n = child_of(parent, addr);
+  n->calls ++;
+  stack[depth ++] = (Frame){ .node = n, .start = instr, .ret = ret };
+}
+
+static void pop(uint64_t instr) {
+  Frame *f = &stack[-- depth];
+  f->node->incl += instr - f->start;
+}
+
+static Node* top() {
+  return (depth == 0 ? &root : stack[depth - 1].node);
+}
+
+// fill in `excl' and sort the children by `incl'
+static void finish(Node *n) {
+  n->excl = n->incl;
+  Node *c, *sorted = NULL;
+  while ((c = n->child) != NULL) {
+    n->child = c->next;
+    finish(c);
+    n->excl -= c->incl;
+    Node **p = &sorted;
+    while (*p != NULL && (*p)->incl >= c->incl) p = &(*p)->next;
+    c->next = *p;
+    *p = c;
+  }
+  n->child = sorted;
+}
+
+static void print_tree(Node *n, int level) {
+  printf("%10lu %14lu %14lu  %*s%s\n", n->calls, n->incl, n->excl, 2 * level, "",
+      (n == &root ? "<root>" : addr_str(n->addr)));
+  Node *c;
+  for (c = n->child; c != NULL; c = c->next) print_tree(c, level + 1);
+}
+
+/* main */
+
+static void usage(const char *prog) {
+  fprintf(stderr, "Usage: %s [-e ELF] [-t] TRACE\n", prog);
+  exit(1);
+}
+
+int main(int argc, char *argv[]) {
+  bool tree = false;
+  int o;
+  while ((o = getopt(argc, argv, "e:t")) != -1) {
+    switch (o) {
+      case 'e': load_elf(optarg); break;
+      case 't': tree = true; break;
+      default: usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1) usage(argv[0]);
+
+  FILE *fp = fopen(argv[optind], "rb");
+  if (fp == NULL) { perror(argv[optind]); return 1; }
+  uint64_t magic = 0;
+  if (fread(&magic, sizeof(magic), 1, fp) != 1 || magic != FTRACE_MAGIC) {
+    fprintf(stderr, "%s is not a function trace\n", argv[optind]);
+    return 1;
+  }
+
+  Record r;
+  uint64_t instr = 0;
+  bool ended = false;
+  while (fread(&r, sizeof(r), 1, fp) == 1) {
+    int kind = r.instr >> 56;
+    instr = r.instr & ((1ull << 56) - 1);
+    switch (kind) {
+      case FTRACE_CALL:
+        if (!tree) printf("%12lu %*scall %s [0x%lx] from %s\n", instr, 2 * depth, "",
+            addr_str(r.to), r.to, addr_str(r.from));
+        push(top(), func_start(r.to), instr, r.from + 4);
+        break;
+      case FTRACE_TAIL: {
+        // an indirect jump is a tail call only when it goes to another function
+        Func *f = find_func(r.to);
+        if (f == NULL || f->addr != r.to || depth == 0) break;
+        if (!tree) printf("%12lu %*stail %s [0x%lx] from %s\n", instr, 2 * (depth - 1), "",
+            addr_str(r.to), r.to, addr_str(r.from));
+        uint64_t ret = stack[depth - 1].ret;
+        pop(instr);
+        push(top(), r.to, instr, ret);
+        break;
+      }
+      case FTRACE_RET: {
+        // returns not matching the calls (e.g. longjmp) unwind to the frame
+        // they return to, or just drop one frame if there is no such frame
+        int d = depth;
+        while (d > 0 && stack[d - 1].ret != r.to) d --;
+        if (d == 0) d = depth;
+        if (d == 0) break;
+        while (depth >= d) {
+          if (!tree) printf("%12lu %*sret  %s -> %s\n", instr, 2 * (depth - 1), "",
+              addr_str(stack[depth - 1].node->addr), addr_str(r.to));
+          pop(instr);
+        }
+        break;
+      }
+      case FTRACE_END: ended = true; break;
+      default: fprintf(stderr, "bad record kind %d\n", kind); return 1;
+    }
+  }
+  fclose(fp);
+  if (!ended) fprintf(stderr, "warning: the trace is not complete\n");
+
+  if (tree) {
+    // the functions not returned yet end with the trace
+    while (depth > 0) pop(instr);
+    root.calls = 1;
+    root.incl = instr;
+    finish(&root);
+    printf("%10s %14s %14s  %s\n", "calls", "incl", "excl", "function");
+    print_tree(&root, 0);
+  }
+  return 0;
+}
@@ -7,12 +7,17 @@
 #include <stdbool.h>
 // this should be enough
 static char buf[65536] = {'\0'};
-static char code_buf[65536 + 128] = {}; // a little larger than `buf`
+// the same expression for C, where every number is cast to the word type,
+// so it is evaluated in unsigned arithmetic of `width' bits as NEMU does
+static char cbuf[65536 * 4] = {'\0'};
+static char code_buf[65536 * 4 + 256] = {}; // a little larger than `cbuf`
+static int width = 64;
 static char *code_format =
 "#include <stdio.h>\n"
+"#include <stdint.h>\n"
 "int main() { "
-"  unsigned result = %s; "
-"  printf(\"%%u\", result); "
+"  uint%d_t result = %s; "
+"  printf(\"%%llu\", (unsigned long long)result); "
 "  return 0; "
 "}";
 
@@ -26,7 +31,7 @@ uint32_t choose(uint32_t n) {
 }
 
 static void gen_rand_expr(bool initialize) {
-  if (initialize) buf[0] = '\0';
+  if (initialize) { buf[0] = '\0'; cbuf[0] = '\0'; }
   switch (choose(4)) {
     case 0: case 1: gen_num(); break;
     case 2: gen("("); gen_rand_expr(false); gen(")"); break;
@@ -36,6 +41,7 @@ static void gen_rand_expr(bool initialize) {
 
 static void gen(char* s) {
   strcat(buf, s);
+  strcat(cbuf, s);
 }
 
 static void gen_num() {
@@ -44,11 +50,13 @@ static void gen_num() {
   char temp[32] = {};
   sprintf(temp, "%u", rnd);
   strcat(buf, temp);
+  sprintf(temp, "((uint%d_t)%u)", width, rnd);
+  strcat(cbuf, temp);
 }
 
 static void gen_rand_op() {
   char* rand_op = op[choose(4)];
-  strcat(buf, rand_op);
+  gen(rand_op);
 }
 
 int main(int argc, char *argv[]) {
@@ -58,13 +66,18 @@ int main(int argc, char *argv[]) {
   if (argc > 1) {
     sscanf(argv[1], "%d", &loop);
   }
+  // the width of word_t of the guest
+  if (argc > 2) {
+    sscanf(argv[2], "%d", &width);
+    assert(width == 32 || width == 64);
+  }
   int i;
   for (i = 0; i < loop; i ++) {
     gen_rand_expr(true);
     if(strlen(buf) > 31) {
       continue;
     }
-    sprintf(code_buf, code_format, buf);
+    sprintf(code_buf, code_format, width, cbuf);
 
     FILE *fp = fopen("/tmp/.code.c", "w");
     assert(fp != NULL);
@@ -77,12 +90,12 @@ int main(int argc, char *argv[]) {
     fp = popen("/tmp/.expr", "r");
     assert(fp != NULL);
 
-    int result;
-    int t = fscanf(fp, "%d", &result);
+    unsigned long long result;
+    int t = fscanf(fp, "%llu", &result);
     t = t;          // avoid unused error
     pclose(fp);
 
-    printf("%u %s\n", result, buf);
+    printf("%llu %s\n", result, buf);
   }
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,70 @@
+// Disassemble the instruction trace written by NEMU with --itrace.
+//   itrace-dump [-n N] TRACE   print the last N instructions, or all of them
+// See include/cpu/iringbuf.h for the format.
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define IRINGBUF_MAGIC 0x3152494e554d454eull // "NEMUNIR1"
+
+typedef struct {
+  uint64_t magic;
+  char triple[32];
+} Header;
+
+typedef struct {
+  uint64_t pc;
+  uint32_t instr;
+  uint32_t ilen;
+} Entry;
+
+void init_disasm(const char *triple);
+void disassemble(char *str, int size, uint64_t pc, uint8_t *code, int nbyte);
+
+static void usage(const char *prog) {
+  fprintf(stderr, "Usage: %s [-n N] TRACE\n", prog);
+  exit(1);
+}
+
+int main(int argc, char *argv[]) {
+  long last = -1;
+  int o;
+  while ((o = getopt(argc, argv, "n:")) != -1) {
+    switch (o) {
+      case 'n': last = atol(optarg); break;
+      default: usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1) usage(argv[0]);
+
+  FILE *fp = fopen(argv[optind], "rb");
+  if (fp == NULL) { perror(argv[optind]); return 1; }
+  Header h;
+  if (fread(&h, sizeof(h), 1, fp) != 1 || h.magic != IRINGBUF_MAGIC) {
+    fprintf(stderr, "%s is not an instruction trace\n", argv[optind]);
+    return 1;
+  }
+  h.triple[sizeof(h.triple) - 1] = '\0';
+  init_disasm(h.triple);
+
+  if (last >= 0) {
+    fseek(fp, 0, SEEK_END);
+    long nr = (ftell(fp) - (long)sizeof(h)) / sizeof(Entry);
+    if (last > nr) last = nr;
+    fseek(fp, sizeof(h) + (nr - last) * sizeof(Entry), SEEK_SET);
+  }
+
+  Entry e;
+  char buf[128];
+  while (fread(&e, sizeof(e), 1, fp) == 1) {
+    int ilen = (e.ilen > sizeof(e.instr) ? sizeof(e.instr) : e.ilen);
+    disassemble(buf, sizeof(buf), e.pc, (uint8_t *)&e.instr, ilen);
+    printf("0x%016lx: %08x  %s\n", e.pc, e.instr, buf);
+  }
+  fclose(fp);
+  return 0;
+}
@@ -2,53 +2,113 @@
 
 static struct gdb_conn *conn;
 
+// Memory writes are pipelined when acks are turned off: up to `PIPELINE_DEPTH`
+// packets are sent before waiting for their replies.
+#define PIPELINE_DEPTH 16
+
+static size_t packet_size = 1500;
+static bool noack = false;
+static bool binary_mem = false;
+
+static bool recv_ok() {
+  size_t size;
+  uint8_t *reply = gdb_recv(conn, &size);
+  bool ok = !strcmp((const char*)reply, "OK");
+  free(reply);
+  return ok;
+}
+
+static void probe_features() {
+  noack = (strcmp(gdb_start_noack(conn), "OK") == 0);
+
+  const char *cmd = "qSupported";
+  gdb_send(conn, (const uint8_t *)cmd, strlen(cmd));
+  size_t size;
+  uint8_t *reply = gdb_recv(conn, &size);
+  char *p = strstr((char *)reply, "PacketSize=");
+  if (p != NULL) packet_size = strtoul(p + strlen("PacketSize="), NULL, 16);
+  free(reply);
+
+  // a zero-length X packet tells whether binary writes are supported
+  cmd = "X0,0:";
+  gdb_send(conn, (const uint8_t *)cmd, strlen(cmd));
+  binary_mem = recv_ok();
+}
+
 bool gdb_connect_qemu(int port) {
   // connect to gdbserver on localhost port 1234
   while ((conn = gdb_begin_inet("127.0.0.1", port)) == NULL) {
     usleep(1);
   }
 
+  probe_features();
   return true;
 }
 
-static bool gdb_memcpy_to_qemu_small(uint32_t dest, void *src, int len) {
-  char *buf = malloc(len * 2 + 128);
-  assert(buf != NULL);
-  int p = sprintf(buf, "M0x%x,%x:", dest, len);
-  int i;
-  for (i = 0; i < len; i ++) {
-    p += sprintf(buf + p, "%c%c", hex_encode(((uint8_t *)src)[i] >> 4), hex_encode(((uint8_t *)src)[i] & 0xf));
-  }
-
-  gdb_send(conn, (const uint8_t *)buf, strlen(buf));
-  free(buf);
-
-  size_t size;
-  uint8_t *reply = gdb_recv(conn, &size);
-  bool ok = !strcmp((const char*)reply, "OK");
-  free(reply);
+static inline bool need_escape(uint8_t c) {
+  return c == '#' || c == '$' || c == '}' || c == '*';
+}
 
-  return ok;
+// build a memory write packet with as much of `src` as it can hold,
+// and return the number of bytes of `src` consumed
+static int build_mem_packet(char *buf, int *pkt_len, uint32_t dest, uint8_t *src, int len) {
+  // leave room for the header
+  int budget = packet_size - 32;
+  int n, p;
+  if (binary_mem) {
+    int escaped = 0;
+    for (n = 0; n < len; n ++) {
+      escaped += (need_escape(src[n]) ? 2 : 1);
+      if (escaped > budget) break;
+    }
+    p = sprintf(buf, "X%x,%x:", dest, n);
+    int i;
+    for (i = 0; i < n; i ++) {
+      if (need_escape(src[i])) {
+        buf[p ++] = '}';
+        buf[p ++] = src[i] ^ 0x20;
+      } else {
+        buf[p ++] = src[i];
+      }
+    }
+  } else {
+    n = (len < budget / 2 ? len : budget / 2);
+    p = sprintf(buf, "M%x,%x:", dest, n);
+    int i;
+    for (i = 0; i < n; i ++) {
+      buf[p ++] = hex_encode(src[i] >> 4);
+      buf[p ++] = hex_encode(src[i] & 0xf);
+    }
+  }
+  *pkt_len = p;
+  return n;
 }
 
 bool gdb_memcpy_to_qemu(uint32_t dest, void *src, int len) {
-  const int mtu = 1500;
+  char *buf = malloc(packet_size + 64);
+  assert(buf != NULL);
+  int depth = (noack ? PIPELINE_DEPTH : 1);
+  int outstanding = 0;
   bool ok = true;
-  while (len > mtu) {
-    ok &= gdb_memcpy_to_qemu_small(dest, src, mtu);
-    dest += mtu;
-    src += mtu;
-    len -= mtu;
+  while (len > 0) {
+    int pkt_len;
+    int n = build_mem_packet(buf, &pkt_len, dest, src, len);
+    gdb_send(conn, (const uint8_t *)buf, pkt_len);
+    outstanding ++;
+    dest += n;
+    src += n;
+    len -= n;
+    if (outstanding == depth) {
+      ok &= recv_ok();
+      outstanding --;
+    }
   }
-  ok &= gdb_memcpy_to_qemu_small(dest, src, len);
+  while (outstanding -- > 0) ok &= recv_ok();
+  free(buf);
   return ok;
 }
 
-bool gdb_getregs(union isa_gdb_regs *r) {
-  gdb_send(conn, (const uint8_t *)"g", 1);
-  size_t size;
-  uint8_t *reply = gdb_recv(conn, &size);
-
+static void parse_regs(uint8_t *reply, union isa_gdb_regs *r) {
   int i;
   uint8_t *p = reply;
   uint8_t c;
@@ -59,7 +119,13 @@ bool gdb_getregs(union isa_gdb_regs *r) {
     p[8] = c;
     p += 8;
   }
+}
 
+bool gdb_getregs(union isa_gdb_regs *r) {
+  gdb_send(conn, (const uint8_t *)"g", 1);
+  size_t size;
+  uint8_t *reply = gdb_recv(conn, &size);
+  parse_regs(reply, r);
   free(reply);
 
   return true;
@@ -94,8 +160,19 @@ bool gdb_si() {
   gdb_send(conn, (const uint8_t *)buf, strlen(buf));
   size_t size;
   uint8_t *reply = gdb_recv(conn, &size);
+  // a stop reply
+  bool ok = (reply[0] == 'T' || reply[0] == 'S');
   free(reply);
-  return true;
+  return ok;
+}
+
+// Step `n` instructions and read the registers. In all-stop mode the target
+// is running after a step until it sends the stop reply, so each step waits
+// for its reply before the next packet is sent.
+bool gdb_si_getregs(uint64_t n, union isa_gdb_regs *r) {
+  bool ok = true;
+  while (n --) ok &= gdb_si();
+  return gdb_getregs(r) && ok;
 }
 
 void gdb_exit() {